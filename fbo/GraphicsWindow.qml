@@ -86,6 +86,44 @@ ApplicationWindow {
 
     }
 
+    // GPU time per layer (GL_TIME_ELAPSED queries, two frames old)
+    Rectangle {
+        id: layer_timings_table
+        anchors.top: chartView.bottom
+        anchors.right: renderer.right
+        anchors.topMargin: 10
+        width: 180
+        height: timings_column.height + 10
+        color: "#CCFFFFFF"
+
+        Column {
+            id: timings_column
+            x: 5
+            y: 5
+
+            Row {
+                Text { text: "Layer"; font.bold: true; width: 110 }
+                Text { text: "GPU [ms]"; font.bold: true; width: 60; horizontalAlignment: Text.AlignRight }
+            }
+
+            Repeater {
+                model: renderer.layer_timings
+                Row {
+                    Text { text: modelData.layer; width: 110 }
+                    Text { text: modelData.ms.toFixed(3); width: 60; horizontalAlignment: Text.AlignRight }
+                }
+            }
+
+            Row {
+                Text { text: "Culled / drawn"; width: 110 }
+                Text {
+                    text: (renderer.culling_statistics.culled || 0) + " / " + (renderer.culling_statistics.visible || 0)
+                    width: 60; horizontalAlignment: Text.AlignRight
+                }
+            }
+        }
+    }
+
     CameraControls {
         camera: renderer  // sets camera property (property var camera) using  MyFrame instance with id renderer
         anchors.bottom: renderer.bottom
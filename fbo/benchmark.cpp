@@ -0,0 +1,321 @@
+/// Headless benchmark of the scene renderer.
+// Renders the demo scene into an offscreen framebuffer for a fixed number of frames and
+// prints CPU frame time percentiles, draw call counts, per-layer GPU time and startup time as JSON on stdout
+// (the renderer's own log goes to stderr). No window or display is needed, it runs on
+// Mesa llvmpipe (eg. LIBGL_ALWAYS_SOFTWARE=1 QT_QPA_PLATFORM=offscreen ./benchmark).
+
+#include "scene_renderer.h"
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QSurfaceFormat>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFramebufferObjectFormat>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+const double FAKE_FRAME_INTERVAL_MS = 1000.0/60.0;  // scene clock step per frame [ms]
+const std::size_t INSTANCE_COUNTS[] = {1, 10, 100, 1000, 10000, 100000};  // steps of --instancing
+const std::size_t MAX_SEPARATE_DRAW_INSTANCES = 10000;  // above, a draw per copy takes seconds per frame
+const int INSTANCING_FRAMES = 20;  // frames per step of --instancing (at most --frames)
+
+// Nearest rank percentile of sorted values
+double percentile(const std::vector<double>& sorted_values, double percent)
+{
+    if (sorted_values.empty()) { return 0.0; }
+    std::size_t rank = static_cast<std::size_t>(std::ceil(percent/100.0*sorted_values.size()));
+    return sorted_values[std::min(std::max<std::size_t>(rank, 1), sorted_values.size()) - 1];
+}
+
+double milliseconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless benchmark of the scene renderer");
+    parser.addHelpOption();
+    QCommandLineOption frames_option("frames", "Number of frames to render.", "count", "1000");
+    QCommandLineOption width_option("width", "Framebuffer width [px].", "pixels", "1280");
+    QCommandLineOption height_option("height", "Framebuffer height [px].", "pixels", "720");
+    QCommandLineOption output_option("output", "Write the JSON report to this file instead of stdout.", "file");
+    QCommandLineOption model_option("model", "Also time submitting this model on its own (eg. resources/objects/nanosuit/nanosuit.obj).", "file");
+    QCommandLineOption instancing_option("instancing", "Also compare drawing 1 to 100k copies of this model one by one and instanced (eg. resources/objects/rock/rock.obj).", "file");
+    QCommandLineOption trace_option("trace", "Record CPU profiler scopes and write them as a Chrome trace.", "file");
+    parser.addOption(frames_option);
+    parser.addOption(width_option);
+    parser.addOption(height_option);
+    parser.addOption(output_option);
+    parser.addOption(model_option);
+    parser.addOption(instancing_option);
+    parser.addOption(trace_option);
+    parser.process(app);
+
+    const int frames = std::max(1, parser.value(frames_option).toInt());
+    const int width = std::max(1, parser.value(width_option).toInt());
+    const int height = std::max(1, parser.value(height_option).toInt());
+
+    // Same context settings as the application
+    QSurfaceFormat format;
+    format.setMajorVersion(3);
+    format.setMinorVersion(3);
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setDepthBufferSize(24);
+    format.setStencilBufferSize(8);
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create()) {
+        std::cerr << "ERROR::BENCHMARK::OPENGL_CONTEXT_NOT_CREATED" << std::endl;
+        return 1;
+    }
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if (!surface.isValid() || !context.makeCurrent(&surface)) {
+        std::cerr << "ERROR::BENCHMARK::OFFSCREEN_SURFACE_NOT_CURRENT" << std::endl;
+        return 1;
+    }
+
+    QOpenGLFramebufferObjectFormat fbo_format;
+    fbo_format.setSamples(4);
+    fbo_format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    QOpenGLFramebufferObject fbo(QSize(width, height), fbo_format);
+    fbo.bind();
+    context.functions()->glViewport(0, 0, width, height);
+
+    if (parser.isSet(trace_option)) {
+        Profiler::instance().set_enabled(true);
+    }
+    Profiler::instance().set_thread_name("main");
+
+    // Keep stdout clean for the report
+    std::streambuf* stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+    auto startup_start = std::chrono::steady_clock::now();
+    std::unique_ptr<SceneRenderer> scene = std::make_unique<SceneRenderer>();
+    context.functions()->glFinish();
+    double startup_ms = milliseconds_since(startup_start);
+
+    SceneInputs inputs;
+    inputs.window_width = width;
+    inputs.window_height = height;
+
+    std::vector<double> frame_ms;
+    frame_ms.reserve(frames);
+    unsigned long draws = 0;
+    unsigned long state_changes_issued = 0;
+    unsigned long state_changes_elided = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        inputs.time_ms = static_cast<float>(frame*FAKE_FRAME_INTERVAL_MS);  // deterministic animation
+
+        auto frame_start = std::chrono::steady_clock::now();
+        scene->render(inputs);
+        frame_ms.push_back(milliseconds_since(frame_start));
+
+        draws += gl_state().frame_statistics().draws;
+        state_changes_issued += gl_state().frame_statistics().issued;
+        state_changes_elided += gl_state().frame_statistics().elided;
+
+        context.functions()->glFinish();  // don't let the driver queue frames, each one starts from an idle GPU
+    }
+    // CPU cost of submitting one model: one vertex array bind per arena, one texture bind per material,
+    // against drawing it mesh by mesh with the vertex array and textures bound again for every mesh
+    // (what drawing a model cost before the meshes shared arenas)
+    QJsonObject model_report;
+    if (parser.isSet(model_option)) {
+        Model model(parser.value(model_option).toStdString());
+        std::shared_ptr<Shader> shader = get_shader(MODEL_VS, MODEL_FS);
+        ShaderRegistry::instance().finalize_all();
+        TextureCache::instance().finalize_all();
+
+        std::vector<MeshSelection> single_mesh(model.meshes.size(), MeshSelection(model.meshes.size(), MESH_CULLED));
+        for (std::size_t i = 0; i < single_mesh.size(); i++) { single_mesh[i][i] = 0; }
+
+        auto time_model = [&](const std::function<void()>& draw, double& cpu_submit_ms_p50) {
+            std::vector<double> submit_ms;
+            unsigned long model_draws = 0;
+            unsigned long model_state_changes = 0;
+            for (int frame = 0; frame < frames; frame++) {
+                gl_state().begin_frame();
+                auto submit_start = std::chrono::steady_clock::now();
+                shader->use();
+                shader->setMat4("model", glm::mat4(1.0f));
+                draw();
+                submit_ms.push_back(milliseconds_since(submit_start));
+                model_draws += gl_state().frame_statistics().draws;
+                model_state_changes += gl_state().frame_statistics().issued;
+                context.functions()->glFinish();
+            }
+            std::sort(submit_ms.begin(), submit_ms.end());
+            cpu_submit_ms_p50 = percentile(submit_ms, 50);
+            QJsonObject report;
+            report["draw_calls"] = static_cast<double>(model_draws)/frames;
+            report["state_changes_issued"] = static_cast<double>(model_state_changes)/frames;
+            report["cpu_submit_ms_p50"] = cpu_submit_ms_p50;
+            report["cpu_submit_ms_p99"] = percentile(submit_ms, 99);
+            return report;
+        };
+        double arena_p50 = 0.0, per_mesh_p50 = 0.0;
+        QJsonObject arena = time_model([&]() { model.Draw(*shader); }, arena_p50);
+        QJsonObject per_mesh = time_model([&]() {
+            for (MeshSelection const& selection: single_mesh) {
+                gl_state().invalidate();  // nothing carried over from the previous mesh
+                model.Draw(*shader, selection);
+            }
+        }, per_mesh_p50);
+
+        model_report["path"] = parser.value(model_option);
+        model_report["meshes"] = static_cast<int>(model.meshes.size());
+        model_report["arenas"] = static_cast<int>(model.arenas.size());
+        model_report["materials"] = static_cast<int>(model.materials.size());
+        model_report["arena"] = arena;
+        model_report["per_mesh"] = per_mesh;
+        model_report["cpu_submit_speedup_p50"] = arena_p50 > 0.0 ? per_mesh_p50/arena_p50 : 0.0;
+    }
+
+    // Scaling of many copies of one model: a Draw per copy against one DrawInstanced
+    QJsonArray instancing_report;
+    if (parser.isSet(instancing_option)) {
+        Model model(parser.value(instancing_option).toStdString());
+        std::shared_ptr<Shader> shader = get_shader(MODEL_VS, MODEL_FS);
+        std::shared_ptr<Shader> instanced_shader = get_shader(MODEL_INSTANCED_VS, MODEL_FS);
+        ShaderRegistry::instance().finalize_all();
+        TextureCache::instance().finalize_all();
+
+        const int step_frames = std::min(frames, INSTANCING_FRAMES);
+        for (std::size_t count: INSTANCE_COUNTS) {
+            // deterministic field of copies on a square grid in front of the camera
+            std::vector<glm::mat4> matrices(count);
+            const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+            for (std::size_t i = 0; i < count; i++) {
+                glm::vec3 position(static_cast<float>(i % side) - 0.5f*side, 0.0f, -static_cast<float>(i/side));
+                matrices[i] = glm::scale(glm::translate(glm::mat4(1.0f), 4.0f*position), glm::vec3(0.5f));
+            }
+
+            QJsonObject step;
+            step["instances"] = static_cast<double>(count);
+            auto time_frames = [&](const std::function<void()>& submit, const char* name) {
+                std::vector<double> submit_ms, total_ms;
+                unsigned long step_draws = 0;
+                for (int frame = 0; frame < step_frames; frame++) {
+                    gl_state().begin_frame();
+                    auto submit_start = std::chrono::steady_clock::now();
+                    submit();
+                    submit_ms.push_back(milliseconds_since(submit_start));
+                    context.functions()->glFinish();
+                    total_ms.push_back(milliseconds_since(submit_start));
+                    step_draws += gl_state().frame_statistics().draws;
+                }
+                std::sort(submit_ms.begin(), submit_ms.end());
+                std::sort(total_ms.begin(), total_ms.end());
+                QJsonObject timing;
+                timing["cpu_submit_ms_p50"] = percentile(submit_ms, 50);
+                timing["frame_ms_p50"] = percentile(total_ms, 50);
+                timing["draw_calls"] = static_cast<double>(step_draws)/step_frames;
+                step[name] = timing;
+            };
+            if (count <= MAX_SEPARATE_DRAW_INSTANCES) {
+                time_frames([&]() {
+                    shader->use();
+                    for (glm::mat4 const& matrix: matrices) {
+                        shader->setMat4("model", matrix);
+                        model.Draw(*shader);
+                    }
+                }, "separate");
+            }
+            time_frames([&]() {
+                instanced_shader->use();
+                model.DrawInstanced(*instanced_shader, matrices);
+            }, "instanced");
+            instancing_report.append(step);
+        }
+    }
+
+    const RenderQueueStatistics queue = scene->render_queue_statistics();
+    QJsonObject gpu_layer_ms;  // last complete GL_TIME_ELAPSED results
+    for (GpuTiming const& timing: scene->gpu_timings()) {
+        gpu_layer_ms[timing.label.c_str()] = timing.milliseconds;
+    }
+    QJsonObject memory;  // resident bytes per layer
+    for (auto const& layer: scene->memory_report()) {
+        QJsonObject usage;
+        usage["cpu_bytes"] = static_cast<double>(layer.second.cpu_bytes);
+        usage["gpu_bytes"] = static_cast<double>(layer.second.gpu_bytes);
+        memory[layer.first.c_str()] = usage;
+    }
+    scene.reset();
+    if (parser.isSet(trace_option)) {
+        Profiler::instance().dump(parser.value(trace_option).toStdString());
+    }
+    std::cout.rdbuf(stdout_buffer);
+
+    std::vector<double> sorted_ms = frame_ms;
+    std::sort(sorted_ms.begin(), sorted_ms.end());
+    double total_ms = 0;
+    for (double ms: frame_ms) { total_ms += ms; }
+
+    QJsonObject frame_time;
+    frame_time["mean"] = total_ms/frames;
+    frame_time["p50"] = percentile(sorted_ms, 50);
+    frame_time["p90"] = percentile(sorted_ms, 90);
+    frame_time["p99"] = percentile(sorted_ms, 99);
+    frame_time["max"] = sorted_ms.back();
+
+    QJsonObject report;
+    report["renderer"] = QString(reinterpret_cast<const char*>(context.functions()->glGetString(GL_RENDERER)));
+    report["frames"] = frames;
+    report["width"] = width;
+    report["height"] = height;
+    report["startup_ms"] = startup_ms;
+    report["cpu_frame_ms"] = frame_time;
+    report["draw_calls_per_frame"] = static_cast<double>(draws)/frames;
+    report["state_changes_issued_per_frame"] = static_cast<double>(state_changes_issued)/frames;
+    report["state_changes_elided_per_frame"] = static_cast<double>(state_changes_elided)/frames;
+    report["render_queue_items"] = static_cast<int>(queue.items);
+    report["program_switches"] = static_cast<int>(queue.program_switches_sorted);
+    report["texture_switches"] = static_cast<int>(queue.texture_switches_sorted);
+    report["culled"] = static_cast<int>(queue.culled);
+    report["visible"] = static_cast<int>(queue.visible);
+    report["gpu_layer_ms"] = gpu_layer_ms;
+    report["memory"] = memory;
+    if (!model_report.isEmpty()) {
+        report["model"] = model_report;
+    }
+    if (!instancing_report.isEmpty()) {
+        report["instancing"] = instancing_report;
+    }
+
+    QByteArray json = QJsonDocument(report).toJson();
+    if (parser.isSet(output_option)) {
+        QFile file(parser.value(output_option));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            std::cerr << "ERROR::BENCHMARK::OUTPUT_NOT_WRITTEN " << parser.value(output_option).toStdString() << std::endl;
+            return 1;
+        }
+        file.write(json);
+    }
+    else {
+        std::cout << json.toStdString();
+    }
+
+    context.doneCurrent();
+    return 0;
+}
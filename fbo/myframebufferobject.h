@@ -4,6 +4,7 @@
 #include <Eigen/Core>
 
 #include <QQuickFramebufferObject>
+#include <QVariantList>
 #include <glm/glm.hpp>
 
 #include <iostream>
@@ -16,6 +17,10 @@ class MyFrameBufferObject : public QQuickFramebufferObject
     Q_PROPERTY(float elevation READ elevation WRITE setElevation NOTIFY elevationChanged)
     Q_PROPERTY(float distance READ distance WRITE setDistance NOTIFY distanceChanged)
     Q_PROPERTY(bool center_to_vehicle READ center_to_vehicle WRITE set_center_to_vehicle NOTIFY center_to_vehicle_changed)
+    // GPU time per layer: list of {"layer": name, "ms": time} updated by the render thread
+    Q_PROPERTY(QVariantList layer_timings READ layer_timings NOTIFY layer_timings_changed)
+    // View frustum culling of the last frame: {"visible": bounds drawn, "culled": bounds skipped}
+    Q_PROPERTY(QVariantMap culling_statistics READ culling_statistics NOTIFY culling_statistics_changed)
 
 public:
     explicit MyFrameBufferObject(QQuickItem *parent = 0);
@@ -25,6 +30,8 @@ public:
     float distance() const;
     float elevation() const;
     bool center_to_vehicle() const;
+    QVariantList layer_timings() const;
+    QVariantMap culling_statistics() const;
     float delta_x();
     float delta_y();
     int mouse_angle();
@@ -40,6 +47,8 @@ signals:
     void distanceChanged(float distance);
     void elevationChanged(float elevation);
     void center_to_vehicle_changed();
+    void layer_timings_changed();
+    void culling_statistics_changed();
 
 public slots:
     void setAzimuth(float azimuth);
@@ -48,6 +57,10 @@ public slots:
     void set_center_to_vehicle(bool center_to_vehicle);
     void request_redraw() { update(); }
     void set_line_visibility(bool visibility);
+    void set_layer_timings(const QVariantList& timings);
+    void set_culling_statistics(const QVariantMap& statistics);
+    // Writes the CPU profiler events recorded so far as a Chrome trace (see profiler.h)
+    bool dump_trace(const QString& path);
 
 protected:
     void mousePressEvent(QMouseEvent *e) override {
@@ -133,6 +146,10 @@ private:
 
     // Toggle
     bool line_visibility_ = true;
+
+    // Statistics
+    QVariantList layer_timings_;
+    QVariantMap culling_statistics_;
 };
 
 #endif // MYFRAMEBUFFEROBJECT_H
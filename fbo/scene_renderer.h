@@ -0,0 +1,541 @@
+#ifndef SCENE_RENDERER_H
+#define SCENE_RENDERER_H
+
+#include <cmath>
+#include <Eigen/Core>
+
+// #include <meshrenderer.h>
+#include <paths.h>
+#include <model.h>
+#include <camera_two.h>
+#include <orbital_camera.h>
+#include <shader.h>
+#include <shader_registry.h>
+#include <texture_cache.h>
+#include <camera_block.h>
+#include <line.h>
+#include <polygon.h>
+#include <point.h>
+#include <cube_map.h>
+#include <text.h>
+#include <label_layer.h>
+#include <delaunay_2_5D.h>
+#include <ellipsoid.h>
+#include <OBB.h>
+#include <render_queue.h>
+#include <gpu_timer.h>
+#include <profiler.h>
+
+// #include <mesh.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+const float EARTH_RADIUS = 6371000; // [m]
+const unsigned long STATISTICS_LOG_INTERVAL = 1000; // [frames]
+const char STATISTICS_LOG_ENVIRONMENT_VARIABLE[] = "OPENGL_PLAYGROUND_STATISTICS";  // set (not "0") to log them
+const float FAR_PLANE = 10*EARTH_RADIUS; // [m]
+
+Eigen::Vector3f sph_to_cart(float radius, float theta, float inc)  // all angles in degrees
+{   // convert cylindrical to cartesian coordinates
+    double x = radius*std::sin(glm::radians(theta))*std::cos(glm::radians(inc));
+    double y = radius*std::sin(glm::radians(theta))*std::sin(glm::radians(inc));
+    double z = radius*std::cos(glm::radians(theta));
+
+    return Eigen::Vector3f(x, y, z);
+};
+
+std::vector<std::string> lineToVectorOfStrings(std::string line)
+{
+    std::stringstream ss(line);
+    std::vector<std::string> strVec;
+    while (ss.good()) {
+        std::string substr;
+        std::getline(ss, substr, ',');
+        strVec.push_back(substr);
+    }
+    return strVec;
+}
+
+void getMapCoords(const std::string& coastLinePath,
+                  std::vector<double>& vecLats,
+                  std::vector<double>& vecLongs,
+                  std::vector<int>& indexes)
+{
+    PROFILE_SCOPE("getMapCoords");
+    // The vector arguments are empty at this point.
+
+    // Read csv file:
+    std::ifstream is(coastLinePath);
+    if (!is.is_open()) {
+        std::string err = "Could not find coastline path at loc: ";
+        err += coastLinePath;
+        throw std::invalid_argument(err);
+    }
+
+    std::string line("");
+    while (std::getline(is, line)) {
+        std::vector<std::string> csv = lineToVectorOfStrings(line);
+        vecLats.push_back(std::stod(csv[0]));
+        vecLongs.push_back(std::stod(csv[1]));
+        indexes.push_back(std::stoi(csv[2]));
+    }
+};
+
+/// Everything the scene reads from the outside world for one frame
+// Filled from the QML item by MyFrameBufferObjectRenderer::synchronize() or by the benchmark.
+struct SceneInputs {
+    float delta_x = 0;  // mouse movement since the last frame
+    float delta_y = 0;
+    int mouse_delta_angle = 0;  // mouse wheel
+    float azimuth = 0;  // [deg]
+    float elevation = 0;  // [deg]
+    bool center_to_vehicle = false;
+    bool draw_line = true;
+    std::pair<bool, glm::vec3> click = std::make_pair(false, glm::vec3(0.0f));  // right click and its ray in NDC
+    float window_width = 1;  // [px]
+    float window_height = 1;  // [px]
+    float time_ms = 0;  // scene clock driving the animation [ms]
+};
+
+/// The demo scene (layers, models and camera) independent of Qt Quick.
+// Needs a current OpenGL 3.3 context for its whole lifetime. Headers in general_inc define
+// non-inline functions, include this from a single translation unit per executable.
+class SceneRenderer: protected QOpenGLFunctions_3_3_Core
+{
+public:
+    SceneRenderer()
+    {
+        PROFILE_SCOPE("SceneRenderer::SceneRenderer");
+        initializeOpenGLFunctions();   // Initialises current context
+        const char* log_statistics = std::getenv(STATISTICS_LOG_ENVIRONMENT_VARIABLE);
+        m_log_statistics = log_statistics != nullptr && log_statistics[0] != '\0' && std::string(log_statistics) != "0";
+
+        // Reuse program binaries linked by previous runs
+        Shader::set_binary_cache_directory(SHADER_CACHE_PATH.string());
+        // and meshes preprocessed by previous runs (or by mesh_bake)
+        Model::set_mesh_cache_directory(MESH_CACHE_PATH.string());
+        // and glyph atlases baked by previous runs
+        FontCache::set_cache_directory(FONT_CACHE_PATH.string());
+
+        // Create shaders
+        m_shader = get_shader(MODEL_VS, MODEL_FS);
+
+        // Create models
+        std::string model_path = (ASSETS_PATH / "natural_earth/natural_earth_110m.obj").string(); 
+        m_model =  std::make_unique<Model>(model_path);
+
+        // Ellipsoid earth 
+        m_ellipsoid_earth = std::make_unique<Ellipsoid>(glm::vec3(0.98*EARTH_RADIUS, 0.98*EARTH_RADIUS, 0.98*EARTH_RADIUS), 40, 40);
+
+        // 
+        model_path = (ASSETS_PATH / "backpack/backpack.obj").string(); 
+        other_model =  std::make_unique<Model>(model_path);
+
+        // Get our rocket
+        std::string rocket_path = (ASSETS_PATH / "/rocket_v1/12217_rocket_v1_l1.obj").string();
+        m_rocket =  std::make_unique<Model>(rocket_path);
+
+        // Ellipsoid
+        m_ellipsoid =  std::make_unique<Ellipsoid>(glm::vec3(0.2*EARTH_RADIUS, 0.2*EARTH_RADIUS, 0.2*EARTH_RADIUS), 40, 40);
+
+        // OBB 
+        m_obb =  std::make_unique<OBB>(glm::vec3(-0.02*EARTH_RADIUS, -0.02*EARTH_RADIUS, -0.1*EARTH_RADIUS), 
+                                       glm::vec3(0.02*EARTH_RADIUS, 0.02*EARTH_RADIUS, 0.25*EARTH_RADIUS), Color::TRANSPARENT_WHITE);
+
+
+        // Camera 
+        m_camera = std::make_unique<OrbitalCamera>(glm::vec3(0.0f, 0.0f, 0.0f), 3*EARTH_RADIUS, 1.0*EARTH_RADIUS);  //new CameraT(glm::vec3(0.0f, 0.0f, 8.0f));
+        
+        // My (static) line
+        std::vector<std::vector<Eigen::Vector3f>> the_lines;
+        std::vector<Eigen::Vector3f> the_coordinates;
+        for (std::size_t i_theta = 0; i_theta <= 360; ++i_theta) {
+            Eigen::Vector3f coordinate = sph_to_cart(m_radius, i_theta, m_inc);
+            the_coordinates.push_back(coordinate);
+        }
+        the_lines.push_back(the_coordinates);
+        m_circular_line =  std::make_unique<Line>(std::move(the_lines), 10); 
+
+        // 
+        // My polygon
+        std::vector<std::vector<Eigen::Vector3f>> the_polygons;
+        std::vector<Eigen::Vector3f> polygon_1_coordinates;
+        polygon_1_coordinates.emplace_back(EARTH_RADIUS, EARTH_RADIUS, EARTH_RADIUS);
+        polygon_1_coordinates.emplace_back(EARTH_RADIUS, 0, EARTH_RADIUS);
+        // polygon_1_coordinates.emplace_back(4, -1, 1);v
+        polygon_1_coordinates.emplace_back(0, 0, EARTH_RADIUS);
+        polygon_1_coordinates.emplace_back(0, EARTH_RADIUS, EARTH_RADIUS);
+        polygon_1_coordinates.emplace_back(EARTH_RADIUS, EARTH_RADIUS, EARTH_RADIUS);
+        the_polygons.push_back(polygon_1_coordinates);
+
+        std::vector<Eigen::Vector3f> polygon_2_coordinates;
+        polygon_2_coordinates.emplace_back(0, EARTH_RADIUS, 0);
+        polygon_2_coordinates.emplace_back(0, EARTH_RADIUS, EARTH_RADIUS);
+        polygon_2_coordinates.emplace_back(0, 0, EARTH_RADIUS);
+        the_polygons.push_back(polygon_2_coordinates);
+
+        m_polygon =  std::make_unique<Polygon3D>(std::move(the_polygons)); 
+
+        // Draw circle on sphere?
+        // Method 1: Flat circle
+        // Choose center point (ECEF) and convert it to NED frame
+        // Draw circle in NE coordinates
+        // Convert coordinates back to ECEF
+        // Draw the polygon (using triangle fan)
+
+        // Method 2: Unfilled curve circle
+        // Choose center point (ECEF)
+        // Find point on sphere that make a (projected) circle
+        // https://en.wikipedia.org/wiki/Circle_of_a_sphere
+        // Push points outward from earth using NED frame
+        // Draw line connecting points
+
+        // My points
+        std::vector<GeoPoint> the_points;
+        the_points.push_back(GeoPoint(Eigen::Vector3f(EARTH_RADIUS, EARTH_RADIUS, -EARTH_RADIUS), "This is a\nnew line\nthis one is a long line"));
+        the_points.push_back(GeoPoint(Eigen::Vector3f(EARTH_RADIUS, -EARTH_RADIUS, -EARTH_RADIUS), "This is point 2"));
+        the_points.push_back(GeoPoint(Eigen::Vector3f(-EARTH_RADIUS, EARTH_RADIUS, EARTH_RADIUS), "This is another point"));
+        the_points.push_back(GeoPoint(Eigen::Vector3f(-EARTH_RADIUS, -EARTH_RADIUS, EARTH_RADIUS), "a\nb\nc"));
+        // Names of the points, every label in one draw
+        m_labels = std::make_unique<LabelLayer>(1.0f/2000.0f);
+        m_labels->set_halo(glm::vec4(1.0f, 1.0f, 1.0f, 0.8f), 2.0f);
+        for (std::size_t i = 0; i < the_points.size(); i++) {
+            const Eigen::Vector3f& coordinate = the_points[i].coordinate;
+            m_labels->add("Point " + std::to_string(i + 1), glm::vec3(coordinate.x(), coordinate.y(), coordinate.z()));
+        }
+        m_points = std::make_unique<Point>(std::move(the_points), 0.1*EARTH_RADIUS, Symbol::CIRCLE);
+
+        std::vector<double> lats;
+        std::vector<double> longs;
+        std::vector<int> indexes;
+        getMapCoords((ROOT_PROJECT_DIRECTORY / "filtered_coast.csv").string(), lats, longs, indexes);
+        int current_index = -999;
+
+        std::vector<ConstrainedDelaunayContourEdges> contour_edges;
+        std::vector<std::vector<std::pair<double, double>>> delaunay_edges;
+        std::vector<std::pair<double, double>> edge;
+        
+        for (std::size_t i = 0; i < lats.size(); ++i) {
+            // TODO Maybe replace with the vector one of these
+            int new_index = indexes[i];
+            
+            if (new_index == current_index || i == 0)
+            {
+                edge.push_back(std::make_pair(longs[i], lats[i]));
+            }
+            else {
+                delaunay_edges.push_back(edge);
+                ConstrainedDelaunayContourEdges contour_edge(delaunay_edges, false);
+                contour_edges.push_back(contour_edge);
+
+                edge.clear();
+                delaunay_edges.clear();
+                edge.push_back(std::make_pair(longs[i], lats[i]));
+            }
+            current_index = new_index;
+        }
+
+        delaunay_edges.push_back(edge);  // Push back last line
+        ConstrainedDelaunayContourEdges contour_edge(delaunay_edges, false);
+        contour_edges.push_back(contour_edge);
+
+        m_projected_shapes = std::make_unique<Delaunay2_5D>(std::move(contour_edges), 1, 1, 5000, Color::RED, true);
+
+        // My text
+        m_text = std::make_unique<Text3D>("Awesome moving rocket", 0.0f, 0.0f, 0.0f, 1.0f/1200.0f);//1.0f/600.0f); 
+        m_text->set_halo(glm::vec4(1.0f, 1.0f, 1.0f, 0.8f), 2.0f);
+
+        // My cubemap
+        m_cubemap = std::make_unique<CubeMap>("path_to_cube_map");
+
+        // All layers have submitted their programs, wait for the driver once for all of them
+        ShaderRegistry::instance().finalize_all();
+        ShaderRegistry::instance().print_statistics();
+        TextureCache::instance().finalize_all();
+        TextureCache::instance().print_statistics();
+        FontCache::instance().print_statistics();
+        print_memory_report();
+    }
+
+    // Frame statistics on stdout every STATISTICS_LOG_INTERVAL frames, off unless the environment
+    // variable asks for them (the overlay and the benchmark report get them either way)
+    void set_log_statistics(bool log)
+    {
+        m_log_statistics = log;
+    }
+
+    // Draws one frame into the currently bound framebuffer
+    void render(const SceneInputs& inputs)
+    {
+        PROFILE_SCOPE("SceneRenderer::render");
+        // The owner of the context (Qt Quick) changes GL state between our frames, start from an unknown state
+        gl_state().begin_frame();
+        m_gpu_timers.begin_frame();
+        TextureCache::instance().upload_ready();  // textures requested after startup
+        FontCache::instance().begin_frame();  // glyph pages drawn from this frame are kept
+
+        // Uniform lookups served from the shaders' location tables during the previous frame
+        m_uniform_lookups_saved = Shader::lookups_saved();
+        Shader::reset_lookup_statistics();
+        if (m_log_statistics && m_frame_count++ % STATISTICS_LOG_INTERVAL == 0) {
+            std::cout << "Uniform lookups saved per frame: " << m_uniform_lookups_saved << std::endl;
+            std::cout << "GL per frame: " << gl_state().last_frame_statistics().draws << " draw calls, state changes "
+                      << gl_state().last_frame_statistics().issued << " issued, "
+                      << gl_state().last_frame_statistics().elided << " elided" << std::endl;
+            const RenderQueueStatistics& queue = m_render_queue.statistics();
+            std::cout << "Render queue: " << queue.items << " draws, program switches "
+                      << queue.program_switches_submitted << " -> " << queue.program_switches_sorted << ", texture switches "
+                      << queue.texture_switches_submitted << " -> " << queue.texture_switches_sorted << " (submitted -> sorted)" << std::endl;
+            std::cout << "View frustum culling: " << queue.visible << " visible, " << queue.culled << " culled" << std::endl;
+            FontCache::instance().print_glyph_statistics();
+        }
+
+        // m_render.render();
+        // don't forget to enable shader before setting uniforms
+        gl_state().enable(GL_DEPTH_TEST);
+        gl_state().enable(GL_STENCIL_TEST);
+        gl_state().depth_func(GL_LESS);
+        // glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        
+        // Rocket Center 
+        float nMilliseconds = inputs.time_ms;
+        float theta = nMilliseconds/100;  //  aol [deg]
+        Eigen::Vector3f cord_r = sph_to_cart(m_radius, theta, m_inc);
+
+        if (inputs.center_to_vehicle) {
+            m_camera->set_camera_target(glm::vec3(cord_r[0], cord_r[1], cord_r[2]));
+        }
+        
+        // view/projection transformations
+        m_camera->process_mouse_scroll(inputs.mouse_delta_angle);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)inputs.window_width / (float)inputs.window_height, (float)0.001*EARTH_RADIUS, FAR_PLANE);  // 
+        // glm::mat4 projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, -50.0f, 50.0f);
+        // for othographic projection zoom to work, scale the object using mouse scroll rather and 
+        // changing the distance of the camera to the object (using the mouse scroll)
+
+        m_camera->process_mouse_movements(inputs.delta_x, inputs.delta_y);
+        glm::mat4 view = m_camera->get_view_matrix();
+
+        // Camera state is uploaded once and shared by every program through the CameraBlock uniform buffer
+        CameraBlock::instance().set_viewport(inputs.window_width, inputs.window_height);
+        CameraBlock::instance().update(view, projection);
+        
+        ///////////////////////////////////
+        // Evaluate incoming ray properties
+        // See https://github.com/opengl-tutorials/ogl/blob/master/misc05_picking/misc05_picking_custom.cpp
+        glm::vec3 ray_ndc = inputs.click.second;
+        glm::vec4 ray_clip_start = glm::vec4(ray_ndc.x, ray_ndc.y, -1.0f, 1.0f); // Ray vector start point in homogeneous clip coordinates
+        glm::vec4 ray_clip_end = glm::vec4(ray_ndc.x, ray_ndc.y, 0.0f, 1.0f); // Ray vector end point in homogeneous clip coordinates
+        
+        // Faster way (just one inverse)
+        glm::mat4 M = glm::inverse(projection * view);
+        glm::vec4 ray_world_start = M * ray_clip_start; ray_world_start /= ray_world_start.w;
+        glm::vec4 ray_world_end   = M * ray_clip_end  ; ray_world_end   /= ray_world_end.w;
+        glm::vec4 ray_direction_world(ray_world_end - ray_world_start);
+
+        glm::vec4 ray_world_origin = ray_world_start;
+        ray_direction_world = glm::normalize(ray_direction_world);
+
+        ///////////////////////////////////
+
+        // Layers submit their draws to the queue, the queue decides the order (see render_queue.h)
+        m_render_queue.begin(view, projection, FAR_PLANE);
+
+        // Skybox pass (after the opaque items, before the transparent ones)
+        m_cubemap->submit(m_render_queue);
+
+        // render the loaded model
+        glm::mat4 model = glm::mat4(1.0f);
+        // model = glm::translate(model, glm::vec3(0.0f, 0.0f, m_current_distance)); // translate it down so it's at the center of the scene
+        float earth_scaling = 1.0f;
+        model = glm::scale(model, glm::vec3(earth_scaling, earth_scaling, earth_scaling));	// it's a bit too big for our scene, so scale it down
+        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));  // elevation rotation
+
+        m_model->submit(m_render_queue, *m_shader, model);
+
+        // render small earth
+        model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(-1.5*EARTH_RADIUS, 0.0f, 0.0f));  // elevation rotation
+        // model = glm::translate(model, glm::vec3(0.0f, 0.0f, m_current_distance)); // translate it down so it's at the center of the scene
+        model = glm::scale(model, glm::vec3(1000000.0f, 1000000.0f, 1000000.0f));	// it's a bit too big for our scene, so scale it down
+        model = glm::rotate(model, glm::radians(inputs.azimuth), glm::vec3(0.0f, 1.0f, 0.0f));  // azimuth rotation 
+        model = glm::rotate(model, glm::radians(inputs.elevation), glm::vec3(1.0f, 0.0f, 0.0f));  // elevation rotation
+        // model = glm::translate(model, glm::vec3(5.0f, 0.0f, 0.0f));  // elevation rotation
+
+        other_model->submit(m_render_queue, *m_shader, model);
+
+        // Lets draw the line
+        if (inputs.draw_line) {
+            m_circular_line->submit(m_render_queue);
+        }
+
+        // Lets draw the polygon
+        m_polygon->submit(m_render_queue);
+        
+        // Draw points
+        if (inputs.click.first) {
+            m_points->test_ray_tracing(view, projection, inputs.click.second);
+            // inputs.click.first = false;  // desactivate mouse click
+        }
+        m_points->submit(m_render_queue);
+
+        // Draw delaunay projection
+        m_projected_shapes->submit(m_render_queue);
+
+        // Draw ellipsoid
+        Eigen::Vector3f cord_ellipsoid = sph_to_cart(m_radius, theta/2, 135);
+        glm::mat4 model_ellipsoid = glm::translate(glm::mat4(1.0f), glm::vec3(cord_ellipsoid[0], cord_ellipsoid[1], cord_ellipsoid[2]));  // 
+        model_ellipsoid = glm::rotate(model_ellipsoid, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));  // y-rotation
+        model_ellipsoid = glm::rotate(model_ellipsoid, glm::radians(-135.0f), glm::vec3(1.0f, 0.0f, 0.0f));  // inclination-rotation
+        model_ellipsoid = glm::rotate(model_ellipsoid, glm::radians(theta), glm::vec3(0.0f, 1.0f, 0.0f));  // theta-rotation
+        model_ellipsoid = glm::rotate(model_ellipsoid, glm::radians(inputs.azimuth), glm::vec3(0.0f, 1.0f, 0.0f));  // azimuth rotation 
+        model_ellipsoid = glm::rotate(model_ellipsoid, glm::radians(inputs.elevation), glm::vec3(1.0f, 0.0f, 0.0f));  // elevation rotation
+        model_ellipsoid = glm::scale(model_ellipsoid, glm::vec3(0.5*theta/360, theta/360, 0.5*theta/360));  // Scale is last (order of operation is reversed! scale -> rotate -> translate)
+
+        // Pick ellipsoid
+        if (inputs.click.first) {
+            if(m_ellipsoid->test_ray_tracing(ray_world_origin, ray_direction_world, model_ellipsoid)) {
+                ellipse_toggled_ = true;
+            }
+            else {
+                ellipse_toggled_ = false;
+            }
+        }
+
+        if (ellipse_toggled_) { 
+            m_ellipsoid->set_fill_color(Color::RED);
+        }
+        else {
+            m_ellipsoid->set_fill_color(Color::BLUE);
+        }
+        m_ellipsoid->submit(m_render_queue, model_ellipsoid);
+
+        m_ellipsoid_earth->submit(m_render_queue);
+
+        /// Draw rocket
+        // std::cout << theta << std::endl;
+
+        // Change this to quaternion one day
+        glm::mat4 model_rocket = glm::mat4(1.0f);
+        model_rocket = glm::translate(model_rocket, glm::vec3(cord_r[0], cord_r[1], cord_r[2]));  // translate it
+        model_rocket = glm::scale(model_rocket, glm::vec3(1000.0f)); // glm::vec3(0.1f)); // (0.001f));	// scale it down
+        // rotations
+        model_rocket = glm::rotate(model_rocket, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));  // y-rotation
+        model_rocket = glm::rotate(model_rocket, glm::radians(-m_inc), glm::vec3(1.0f, 0.0f, 0.0f));  // inclination-rotation
+        model_rocket = glm::rotate(model_rocket, glm::radians(theta), glm::vec3(0.0f, 1.0f, 0.0f));  // theta-rotation
+
+        glm::mat4 model_obb = glm::mat4(1.0f);
+        model_obb = glm::translate(model_obb, glm::vec3(cord_r[0], cord_r[1], cord_r[2]));  // translate it
+        model_obb = glm::rotate(model_obb, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));  // y-rotation
+        model_obb = glm::rotate(model_obb, glm::radians(-m_inc), glm::vec3(1.0f, 0.0f, 0.0f));  // inclination-rotation
+        model_obb = glm::rotate(model_obb, glm::radians(theta), glm::vec3(0.0f, 1.0f, 0.0f));  // theta-rotation
+
+        // Draw OBB
+        if (inputs.click.first) {
+            if(m_obb->test_ray_tracing(glm::vec3(ray_world_origin), glm::vec3(ray_direction_world), model_obb)) {
+                obb_toggled_ = true;
+            }
+            else {
+                obb_toggled_ = false;
+            }
+        }
+        if (obb_toggled_) { m_obb->submit(m_render_queue, model_obb); };
+
+        // Draw rocket
+        m_rocket->submit(m_render_queue, *m_shader, model_rocket);
+
+        /// Text is blended, it is drawn with the transparent items after the skybox
+        Eigen::Vector3f cord_text = sph_to_cart(1.05*m_radius, theta, m_inc);
+        m_text->update_position(cord_text[0], cord_text[1], cord_text[2]);
+        m_text->submit(m_render_queue);
+        m_labels->submit(m_render_queue);
+
+        m_render_queue.flush(&m_gpu_timers);  // every layer draw is wrapped in a GL_TIME_ELAPSED query
+    }
+
+    // GPU time per layer, from the queries of two frames ago
+    const std::vector<GpuTiming>& gpu_timings() const
+    {
+        return m_gpu_timers.timings();
+    }
+
+    // Resident bytes of every layer, CPU (heap) and GPU (buffers), see Retention in utilities.h
+    std::vector<std::pair<std::string, MemoryUsage>> memory_report() const
+    {
+        return {{"model earth", m_model->memory_usage()},
+                {"model backpack", other_model->memory_usage()},
+                {"model rocket", m_rocket->memory_usage()},
+                {"ellipsoid", m_ellipsoid->memory_usage()},
+                {"ellipsoid earth", m_ellipsoid_earth->memory_usage()},
+                {"obb", m_obb->memory_usage()},
+                {"lines", m_circular_line->memory_usage()},
+                {"polygons", m_polygon->memory_usage()},
+                {"points", m_points->memory_usage()},
+                {"labels", m_labels->memory_usage()},
+                {"delaunay", m_projected_shapes->memory_usage()}};
+    }
+
+    void print_memory_report() const
+    {
+        MemoryUsage total;
+        std::cout << "Layer memory (CPU KiB / GPU KiB):" << std::endl;
+        for (auto const& layer: memory_report()) {
+            std::cout << "  " << layer.first << ": " << layer.second.cpu_bytes/1024.0 << " / " << layer.second.gpu_bytes/1024.0 << std::endl;
+            total += layer.second;
+        }
+        std::cout << "  total: " << total.cpu_bytes/1024.0 << " / " << total.gpu_bytes/1024.0 << std::endl;
+    }
+
+    const RenderQueueStatistics& render_queue_statistics() const
+    {
+        return m_render_queue.statistics();
+    }
+
+private:
+    // MeshRenderer m_render;
+    std::shared_ptr<Shader> m_shader;
+    RenderQueue m_render_queue;
+    GpuTimers m_gpu_timers;
+    // Shader* m_line_shader;
+    std::unique_ptr<Model> m_model;
+
+    std::unique_ptr<Model> other_model;
+    std::unique_ptr<Model> m_rocket;
+    std::unique_ptr<Ellipsoid> m_ellipsoid;
+    std::unique_ptr<Ellipsoid> m_ellipsoid_earth;
+    std::unique_ptr<OBB> m_obb;
+    std::unique_ptr<Line> m_circular_line;
+    std::unique_ptr<Polygon3D> m_polygon;
+    std::unique_ptr<Delaunay2_5D> m_projected_shapes;
+    std::unique_ptr<Point> m_points;
+    std::unique_ptr<Text3D> m_text;
+    std::unique_ptr<LabelLayer> m_labels;
+    std::unique_ptr<CubeMap> m_cubemap;
+    std::unique_ptr<OrbitalCamera> m_camera;
+
+    // Orbital line properties
+    float m_radius = 1.2*EARTH_RADIUS;  // [m]
+    float m_inc = 45;  // inclination angle [deg]
+
+    // Statistics
+    unsigned long m_frame_count = 0;
+    bool m_log_statistics = false;
+    unsigned long m_uniform_lookups_saved = 0;
+
+    // Picking
+    bool obb_toggled_ = false;  // control obb visibility control
+    bool ellipse_toggled_ = false; // control ellipsoid color
+};
+
+
+#endif // SCENE_RENDERER_H
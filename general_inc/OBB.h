@@ -9,7 +9,10 @@
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/profiler.h>
 #include <general_inc/utilities.h> // colors
 
 
@@ -21,17 +24,20 @@ public:
 
     // aabb_min is the box bottom left corner for a right hand cartesian system
     // aabb_max is the box top right corner for a right hand cartesian system
-    OBB(glm::vec3 aabb_min, glm::vec3 aabb_max, Color fill_color = Color::GREEN, Color linecolor = Color::BLACK)
+    // Picking only needs the corners, Retention::KEEP_ALL also keeps the vertices and indices
+    OBB(glm::vec3 aabb_min, glm::vec3 aabb_max, Color fill_color = Color::GREEN, Color linecolor = Color::BLACK,
+        Retention retention = Retention::DROP_AFTER_UPLOAD)
     {
         fill_color_ = fill_color;
         linecolor_ = linecolor;
         aabb_min_ = aabb_min;
         aabb_max_ = aabb_max;
+        bounds_.box.extend(aabb_min_);
+        bounds_.box.extend(aabb_max_);
+        bounds_.sphere = {bounds_.box.center(), glm::length(bounds_.box.half_size())};
 
-        // OBB shader
-        const char* obb_vertex_shader_path = OBB_VS.string().c_str();
-        const char* obb_fragment_shader_path = OBB_FS.string().c_str();
-        obb_shader_ = new Shader(obb_vertex_shader_path, obb_fragment_shader_path);
+        // OBB shader (shared between all boxes)
+        obb_shader_ = get_shader(OBB_VS, OBB_FS);
 
         // Lets create the vertex position array
         vertices_.emplace_back(glm::vec3(aabb_min_.x, aabb_min_.y, aabb_min_.z));
@@ -74,11 +80,12 @@ public:
  
         // Setup opengl states
         setup(); 
-    }
 
-    ~OBB() {
-        // delete m_outline_lines;
-        delete obb_shader_;
+        if (retention != Retention::KEEP_ALL) {
+            release(vertices_);
+            release(indices_);
+            release(line_indices_);
+        }
     }
 
     void setup()
@@ -88,15 +95,20 @@ public:
         glGenBuffers(1, &vbo_);
         glGenBuffers(1, &ebo_);
 
-        glBindVertexArray(vao_);  
+        gl_state().bind_vertex_array(vao_);  
 
         // load vertex data into buffer
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(SimpleVertex), &vertices_[0], GL_STATIC_DRAW);  
 
-        // load index data into element buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size()*sizeof(unsigned int), &indices_[0], GL_STATIC_DRAW);
+        // load index data into element buffer, the faces followed by the outline
+        triangle_index_count_ = indices_.size();
+        line_index_count_ = line_indices_.size();
+        gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (triangle_index_count_ + line_index_count_)*sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, triangle_index_count_*sizeof(unsigned int), indices_.data());
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangle_index_count_*sizeof(unsigned int), line_index_count_*sizeof(unsigned int), line_indices_.data());
+        vertex_count_ = vertices_.size();
 
         // set the vertex attribute pointers:
         // vertex Positions
@@ -109,41 +121,43 @@ public:
         fill_color_ = fill_color;
     }
 
-    void draw(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f), glm::mat4 model_matrix = glm::mat4(1.0f))
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix, glm::mat4 model_matrix = glm::mat4(1.0f))
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw(model_matrix);
+    }
+
+    // Draw using the camera matrices of the shared CameraBlock uniform buffer
+    void draw(glm::mat4 model_matrix = glm::mat4(1.0f))
     {
-        glEnable(GL_BLEND);  // enabling blending 
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // setting blending function
+        gl_state().enable(GL_BLEND);  // enabling blending 
+        gl_state().blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // setting blending function
+        gl_state().disable(GL_CULL_FACE);
 
         obb_shader_->use();  // Bind shader
 
         // Set the uniforms:
         glm::vec4 ourcolor = get_color(fill_color_);  // get the color
         obb_shader_->setVec4("ourColor", ourcolor); // Set uniform
-        obb_shader_->setMat4("view", view_matrix);
-        obb_shader_->setMat4("projection", projection_matrix);
         obb_shader_->setMat4("model", model_matrix);
     
         // Draw triangles
         //glEnable(GL_MULTISAMPLE);  // Antialiasing
-        glBindVertexArray(vao_);
-
-        // Draw ellipsoid
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size()*sizeof(unsigned int), &indices_[0], GL_STATIC_DRAW);
+        gl_state().bind_vertex_array(vao_);
 
-        glEnable(GL_POLYGON_OFFSET_FILL);
-        glPolygonOffset(1.0, 1.0f); // move polygon backward
-        glDrawElements(GL_TRIANGLES, (unsigned int)indices_.size(), GL_UNSIGNED_INT, 0);  // Set element buffer for triangle faces
-        glDisable(GL_POLYGON_OFFSET_FILL);
+        // Draw faces
+        gl_state().enable(GL_POLYGON_OFFSET_FILL);
+        gl_state().polygon_offset(1.0f, 1.0f); // move polygon backward
+        glDrawElements(GL_TRIANGLES, (GLsizei)triangle_index_count_, GL_UNSIGNED_INT, 0);
+        gl_state().count_draw();
+        gl_state().disable(GL_POLYGON_OFFSET_FILL);
 
         // Draw lines
         ourcolor = get_color(linecolor_);
         obb_shader_->setVec4("ourColor", ourcolor); // Set uniform
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, line_indices_.size()*sizeof(unsigned int), &line_indices_[0], GL_STATIC_DRAW);  // Update element buffer
-        // for lines
-        glDrawElements(GL_LINES, (unsigned int)line_indices_.size(), GL_UNSIGNED_INT, 0);
-
-        glBindVertexArray(0);  // Unbind vao
-        glDisable(GL_BLEND);  
+        glDrawElements(GL_LINES, (GLsizei)line_index_count_, GL_UNSIGNED_INT, (void*)(triangle_index_count_*sizeof(unsigned int)));
+        gl_state().count_draw();
     }
 
     // ray_ndc: incoming ray in normalised device coordinates
@@ -152,6 +166,7 @@ public:
         glm::vec3 ray_world_direction,     // Ray direction (NOT target position!), in world space. Must be normalize()'d.
         glm::mat4 model_matrix       // Transformation applied to the mesh (which will thus be also applied to its bounding box),
     ){
+        PROFILE_SCOPE("OBB::test_ray_tracing");
         // Compute local axes (wrt world axes) R matrix
         glm::vec3 x_axis(model_matrix[0].x, model_matrix[0].y, model_matrix[0].z);
         glm::vec3 y_axis(model_matrix[1].x, model_matrix[1].y, model_matrix[1].z);
@@ -288,16 +303,45 @@ public:
 
     }
 
+    // The box is blended so it goes with the transparent items (drawn back to front). The matrix is kept
+    // by the queue, the closure stays small enough for std::function not to allocate.
+    void submit(RenderQueue& queue, glm::mat4 model_matrix = glm::mat4(1.0f))
+    {
+        if (!queue.visible(bounds_, model_matrix))
+            return;
+        glm::vec3 position = glm::vec3(model_matrix * glm::vec4(0.5f*(aabb_min_ + aabb_max_), 1.0f));
+        queue.submit(RenderPass::TRANSPARENT, "obb", obb_shader_->ID, 0, position, model_matrix,
+                     [this](const DrawParameters& parameters) { draw(parameters.matrices[0]); });
+    }
+
+    // Model space box and sphere, tested against the view frustum before submitting
+    const Bounds& bounds() const
+    {
+        return bounds_;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(vertices_) + heap_bytes(indices_) + heap_bytes(line_indices_);
+        usage.gpu_bytes = vertex_count_*sizeof(SimpleVertex) + (triangle_index_count_ + line_index_count_)*sizeof(unsigned int);
+        return usage;
+    }
+
 private:
     Color fill_color_ = Color::GREEN;
     Color linecolor_ = Color::BLUE;
 
-    std::vector<SimpleVertex> vertices_;
-    std::vector<unsigned int> indices_;
-    std::vector<unsigned int> line_indices_;
+    std::vector<SimpleVertex> vertices_;      // empty after setup() unless Retention::KEEP_ALL
+    std::vector<unsigned int> indices_;       // faces
+    std::vector<unsigned int> line_indices_;  // outline
+    std::size_t vertex_count_ = 0;
+    Bounds bounds_;
+    std::size_t triangle_index_count_ = 0;   // line indices follow the triangle ones in ebo_
+    std::size_t line_index_count_ = 0;
 
     unsigned int vao_, vbo_, ebo_;
-    Shader* obb_shader_;
+    std::shared_ptr<Shader> obb_shader_;
 
     glm::vec3 aabb_min_;  // is the box bottom left corner for a right hand cartesian system
     glm::vec3 aabb_max_;  // is the box top right corner for a right hand cartesian system
@@ -9,7 +9,8 @@
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
 #include <general_inc/utilities.h> // colors
 
 #include <ft2build.h>
@@ -29,11 +30,8 @@ public:
         
         initializeOpenGLFunctions();   // Initialise current context  (required)
 
-        // Text shaders
-        const char* vertex_billboard = BILLBOARD_VS.string().c_str();
-        const char* fragment_billboard = BILLBOARD_FS.string().c_str();
-        const char* geometry_billboard = BILLBOARD_GS.string().c_str();
-        m_shader = new Shader(vertex_billboard, fragment_billboard, geometry_billboard);
+        // Billboard shader (shared between all billboards)
+        m_shader = get_shader(BILLBOARD_VS, BILLBOARD_FS, BILLBOARD_GS);
 
         // positions
         m_top_left_pos = glm::vec3(top_left.x(), top_left.y(), top_left.z());
@@ -41,18 +39,13 @@ public:
         setup();
     }
 
-    ~BillboardPolygon() {
-        delete m_shader;
-    }
-
     void change_billboard(Eigen::Vector3f top_left, float size_x, float size_y)
     {
         m_top_left_pos = glm::vec3(top_left.x(), top_left.y(), top_left.z());
 
         // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);  // called while rendering, keep the state cache in sync
         glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3), &m_top_left_pos[0]);  // sets data within a specified region
-        glBindBuffer(GL_ARRAY_BUFFER, 0);  // Release buffer
 
         m_size_x = size_x + width_margins_;  // in clip space
         m_size_y = size_y + height_margins_; // in clip space
@@ -64,10 +57,10 @@ public:
         glGenVertexArrays(1, &vao_);
         glGenBuffers(1, &vbo_);
 
-        glBindVertexArray(vao_);  
+        gl_state().bind_vertex_array(vao_);  
 
         // load data into buffers
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, 1 * sizeof(glm::vec3), &m_top_left_pos[0], GL_STATIC_DRAW);  
 
         // set the vertex attribute pointers:
@@ -76,9 +69,17 @@ public:
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
     }
 
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
     void draw(glm::mat4 view_matrix, 
               glm::mat4 projection_matrix,
               bool fixed_size = true)
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw(fixed_size);
+    }
+
+    // Draw using the camera matrices (and camera right/up vectors) of the shared CameraBlock uniform buffer
+    void draw(bool fixed_size = true)
     {
         // OpenGL state
         // ------------
@@ -89,28 +90,24 @@ public:
         // activate corresponding render state	
         m_shader->use();
 
-		// http://www.opengl-tutorial.org/intermediate-tutorials/billboards-particles/billboards/
-		m_shader->setVec3("camera_right_worldspace", view_matrix[0][0], view_matrix[1][0], view_matrix[2][0]);
-		m_shader->setVec3("camera_up_worldspace", view_matrix[0][1], view_matrix[1][1], view_matrix[2][1]);
         // m_shader->setBool("fixed_size", fixed_size);
         m_shader->setFloat("size_x", m_size_x);
         m_shader->setFloat("size_y", m_size_y);
 
-        m_shader->setMat4("projection", projection_matrix);
-        m_shader->setMat4("view", view_matrix);
         m_shader->setVec4("billboardColor", m_color); // Set uniform
-        glBindVertexArray(vao_);
 
         // Draw point
-        glBindVertexArray(vao_);
+        gl_state().disable(GL_CULL_FACE);
+        gl_state().disable(GL_BLEND);
+        gl_state().bind_vertex_array(vao_);
         glDrawArrays(GL_POINTS, 0, 1);  // Only one point required here
-        glBindVertexArray(0);  // Unbind vao
+        gl_state().count_draw();
     }
 
 private:
 
     std::map<GLchar, Character> m_characters;
-    Shader* m_shader;
+    std::shared_ptr<Shader> m_shader;
     unsigned int vao_, vbo_;
 
     glm::vec3 m_top_left_pos;
@@ -0,0 +1,184 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/// Axis aligned box, empty (min above max) until a point is added
+struct AABB {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    bool empty() const { return min.x > max.x; }
+    glm::vec3 center() const { return 0.5f*(min + max); }
+    glm::vec3 half_size() const { return 0.5f*(max - min); }
+
+    void extend(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void extend(const AABB& box)
+    {
+        if (box.empty()) { return; }
+        extend(box.min);
+        extend(box.max);
+    }
+
+    // Box around this one once transformed (Arvo, "Transforming Axis-Aligned Bounding Boxes")
+    AABB transformed(const glm::mat4& matrix) const
+    {
+        if (empty()) { return *this; }
+        glm::vec3 c = glm::vec3(matrix*glm::vec4(center(), 1.0f));
+        glm::vec3 h = half_size();
+        glm::vec3 e = glm::abs(glm::vec3(matrix[0]))*h.x + glm::abs(glm::vec3(matrix[1]))*h.y + glm::abs(glm::vec3(matrix[2]))*h.z;
+        AABB box;
+        box.min = c - e;
+        box.max = c + e;
+        return box;
+    }
+};
+
+/// Sphere, empty while the radius is negative
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = -1.0f;
+
+    bool empty() const { return radius < 0.0f; }
+
+    // Smallest sphere holding this one and other
+    void extend(const BoundingSphere& other)
+    {
+        if (other.empty()) { return; }
+        if (empty()) { *this = other; return; }
+        glm::vec3 offset = other.center - center;
+        float distance = glm::length(offset);
+        if (distance + other.radius <= radius) { return; }  // other inside
+        if (distance + radius <= other.radius) { *this = other; return; }
+        float new_radius = 0.5f*(distance + radius + other.radius);
+        center += offset*((new_radius - radius)/distance);
+        radius = new_radius;
+    }
+
+    // Sphere holding this one once transformed (the radius grows with the largest axis scale)
+    BoundingSphere transformed(const glm::mat4& matrix) const
+    {
+        if (empty()) { return *this; }
+        float scale = std::max({glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))});
+        return {glm::vec3(matrix*glm::vec4(center, 1.0f)), radius*scale};
+    }
+};
+
+/// Box and sphere of a mesh or layer in its model space. The sphere is the cheap first test, the
+// box the tighter one for long thin shapes.
+struct Bounds {
+    AABB box;
+    BoundingSphere sphere;
+
+    bool empty() const { return box.empty(); }
+
+    void extend(const Bounds& other)
+    {
+        box.extend(other.box);
+        sphere.extend(other.sphere);
+    }
+
+    // Grows both by margin on every side, for shapes drawn larger than their vertices
+    void pad(float margin)
+    {
+        if (empty()) { return; }
+        box.min -= glm::vec3(margin);
+        box.max += glm::vec3(margin);
+        sphere.radius += margin;
+    }
+};
+
+// Bounds of the points of a range, to_point giving each element as a glm::vec3. The sphere is
+// centred on the box, which stays within a few percent of the smallest sphere for meshes.
+template <typename Range, typename ToPoint>
+Bounds bounds_of(const Range& elements, ToPoint to_point)
+{
+    Bounds bounds;
+    for (auto const& element: elements) { bounds.box.extend(to_point(element)); }
+    if (bounds.box.empty()) { return bounds; }
+    bounds.sphere.center = bounds.box.center();
+    float radius2 = 0.0f;
+    for (auto const& element: elements) {
+        glm::vec3 offset = to_point(element) - bounds.sphere.center;
+        radius2 = std::max(radius2, glm::dot(offset, offset));
+    }
+    bounds.sphere.radius = std::sqrt(radius2);
+    return bounds;
+}
+
+template <typename Range>
+Bounds bounds_of(const Range& points)
+{
+    return bounds_of(points, [](const glm::vec3& point) { return point; });
+}
+
+/// The six planes of a view volume in world space, inside on their positive side.
+// Extracted from projection * view (Gribb and Hartmann, "Fast Extraction of Viewing Frustum
+// Planes from the World-View-Projection Matrix"). The default frustum holds everything.
+class Frustum
+{
+public:
+    Frustum()
+    {
+        for (glm::vec4& plane: planes_) { plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); }
+    }
+
+    explicit Frustum(const glm::mat4& view_projection)
+    {
+        const glm::vec4 row0(view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0]);
+        const glm::vec4 row1(view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1]);
+        const glm::vec4 row2(view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2]);
+        const glm::vec4 row3(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+        planes_[0] = row3 + row0;  // left
+        planes_[1] = row3 - row0;  // right
+        planes_[2] = row3 + row1;  // bottom
+        planes_[3] = row3 - row1;  // top
+        planes_[4] = row3 + row2;  // near
+        planes_[5] = row3 - row2;  // far
+        for (glm::vec4& plane: planes_) {
+            float length = glm::length(glm::vec3(plane));
+            if (length > 0.0f) { plane /= length; }
+        }
+    }
+
+    bool intersects(const BoundingSphere& sphere) const
+    {
+        for (glm::vec4 const& plane: planes_) {
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) { return false; }
+        }
+        return true;
+    }
+
+    // Only the corner furthest along each plane's normal is tested
+    bool intersects(const AABB& box) const
+    {
+        for (glm::vec4 const& plane: planes_) {
+            glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+                             plane.y >= 0.0f ? box.max.y : box.min.y,
+                             plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) { return false; }
+        }
+        return true;
+    }
+
+    // Model space bounds placed by model_matrix, empty bounds are never culled
+    bool intersects(const Bounds& bounds, const glm::mat4& model_matrix) const
+    {
+        if (bounds.empty()) { return true; }
+        return intersects(bounds.sphere.transformed(model_matrix)) && intersects(bounds.box.transformed(model_matrix));
+    }
+
+private:
+    glm::vec4 planes_[6];
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef CAMERA_BLOCK_H
+#define CAMERA_BLOCK_H
+
+#include <glm/glm.hpp>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <general_inc/shader.h>  // CAMERA_BLOCK_BINDING
+#include <general_inc/gl_state.h>
+
+/// CPU copy of the std140 "CameraBlock" uniform block declared by every shader in shaders/
+// mat4 and vec4 members are already 16 byte aligned so the struct maps 1:1 onto std140
+struct CameraBlockData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 view_projection;
+    glm::vec4 camera_right;   // world space camera right vector (w unused)
+    glm::vec4 camera_up;      // world space camera up vector (w unused)
+    glm::vec4 viewport;       // width, height, 1/width, 1/height [px]
+};
+
+/// Uniform buffer holding the camera state, uploaded once per frame and read by all programs
+class CameraBlock: protected QOpenGLFunctions_3_3_Core
+{
+public:
+    static CameraBlock& instance()
+    {
+        static CameraBlock camera_block;
+        return camera_block;
+    }
+
+    void set_viewport(float width, float height)
+    {
+        if (width > 0 && height > 0) {
+            data_.viewport = glm::vec4(width, height, 1.0f/width, 1.0f/height);
+        }
+    }
+
+    // Uploads the camera state and binds the buffer to CAMERA_BLOCK_BINDING
+    void update(const glm::mat4& view_matrix, const glm::mat4& projection_matrix)
+    {
+        data_.view = view_matrix;
+        data_.projection = projection_matrix;
+        data_.view_projection = projection_matrix * view_matrix;
+        // http://www.opengl-tutorial.org/intermediate-tutorials/billboards-particles/billboards/
+        data_.camera_right = glm::vec4(view_matrix[0][0], view_matrix[1][0], view_matrix[2][0], 0.0f);
+        data_.camera_up = glm::vec4(view_matrix[0][1], view_matrix[1][1], view_matrix[2][1], 0.0f);
+
+        gl_state().bind_buffer(GL_UNIFORM_BUFFER, ubo_);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlockData), &data_);
+        glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, ubo_);  // also leaves ubo_ bound to GL_UNIFORM_BUFFER
+        uploaded_ = true;
+    }
+
+    // Only uploads when the matrices differ from the current ones (used by the draw(view, projection) overloads)
+    void update_if_changed(const glm::mat4& view_matrix, const glm::mat4& projection_matrix)
+    {
+        if (uploaded_ && view_matrix == data_.view && projection_matrix == data_.projection)
+            return;
+        update(view_matrix, projection_matrix);
+    }
+
+    const CameraBlockData& data() const
+    {
+        return data_;
+    }
+
+private:
+    CameraBlock()
+    {
+        initializeOpenGLFunctions();   // Initialise current context  (required)
+
+        glGenBuffers(1, &ubo_);
+        gl_state().bind_buffer(GL_UNIFORM_BUFFER, ubo_);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlockData), NULL, GL_DYNAMIC_DRAW);
+    }
+    CameraBlock(const CameraBlock&) = delete;
+    CameraBlock& operator=(const CameraBlock&) = delete;
+
+    unsigned int ubo_;
+    bool uploaded_ = false;
+    CameraBlockData data_ = {glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f),
+                             glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                             glm::vec4(1.0f)};
+};
+
+#endif
@@ -1,13 +1,19 @@
 #include <Eigen/Core>
 
+#include <future>
 #include <vector>
 #include <stdexcept>
 
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/profiler.h>
 #include <general_inc/paths.h>
+#include <general_inc/texture_cache.h>
+#include <general_inc/thread_pool.h>
 
 float skybox_vertices[] = {
     // positions          
@@ -62,10 +68,8 @@ public:
     CubeMap() = delete; // need to at least give the filenames
     CubeMap(std::string cube_map_path){
 
-        // Point shader
-        const char* vertex_shader_path = CUBEMAP_VS.string().c_str();
-        const char* fragment_shader_path = CUBEMAP_FS.string().c_str();
-        m_cubemap_shader = new Shader(vertex_shader_path, fragment_shader_path);
+        // Cubemap shader
+        m_cubemap_shader = get_shader(CUBEMAP_VS, CUBEMAP_FS);
 
         initializeOpenGLFunctions();   // Initialise current context  (required)
 
@@ -89,26 +93,27 @@ public:
 
     unsigned int load_cube_map(vector<std::string> faces)
     {
+        PROFILE_SCOPE("CubeMap::load_cube_map");
         unsigned int textureID;
         glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        gl_state().bind_texture(0, GL_TEXTURE_CUBE_MAP, textureID);
 
-        stbi_set_flip_vertically_on_load(false);
-        int width, height, nrChannels;
+        // decode the faces in parallel on the worker pool, upload them here in order
+        vector<std::future<DecodedImage>> decoded;
+        for (auto const& face: faces)
+            decoded.push_back(worker_pool().submit([face]() { return decode_image(face, false); }));
         for (unsigned int i = 0; i < faces.size(); i++)
         {
-            unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-            if (data)
+            DecodedImage image = decoded[i].get();
+            if (image.pixels)
             {
                 glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
-                            0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
+                            0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels.get()
                 );
-                stbi_image_free(data);
             }
             else
             {
                 std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-                stbi_image_free(data);
             }
         }
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -124,39 +129,50 @@ public:
     {
         glGenVertexArrays(1, &vao_);
         glGenBuffers(1, &vbo_);
-        glBindVertexArray(vao_);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_vertex_array(vao_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skybox_vertices), &skybox_vertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     }
 
-    void draw(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f))
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix)
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw();
+    }
+
+    // Draw using the camera matrices of the shared CameraBlock uniform buffer
+    void draw()
     {
         // draw skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+        gl_state().depth_func(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
         
         m_cubemap_shader->use();
         m_cubemap_shader->setInt("skybox", 0);
 
-        glm::mat4 view = glm::mat4(glm::mat3(view_matrix)); // remove translation from the view matrix
-        m_cubemap_shader->setMat4("view", view);
-        m_cubemap_shader->setMat4("projection", projection_matrix);
-
         // Draw skybox cube
-        glBindVertexArray(vao_);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemap_texture);
+        gl_state().disable(GL_CULL_FACE);
+        gl_state().disable(GL_BLEND);
+        gl_state().bind_vertex_array(vao_);
+        gl_state().bind_texture(0, GL_TEXTURE_CUBE_MAP, m_cubemap_texture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
+        gl_state().count_draw();
+        gl_state().depth_func(GL_LESS); // set depth function back to default
+    }
+
+    // The skybox is drawn after the opaque items so only uncovered pixels are shaded
+    void submit(RenderQueue& queue)
+    {
+        queue.submit(RenderPass::SKYBOX, "cubemap", m_cubemap_shader->ID, m_cubemap_texture, glm::vec3(0.0f), [this]() { draw(); });
     }
 
     private:
         unsigned int vao_, vbo_;
         unsigned int m_cubemap_texture;
 
-        Shader* m_cubemap_shader;
+        std::shared_ptr<Shader> m_cubemap_shader;
 
 
 };
\ No newline at end of file
@@ -2,13 +2,17 @@
 #include <Eigen/Core>
 
 #include <algorithm>
+#include <utility>
 #include <vector>
 #include <stdexcept>
 
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/profiler.h>
 #include <general_inc/line.h>
 #include <general_inc/utilities.h> // colors
 
@@ -72,9 +76,7 @@ public:
         fill_color_ = fill_color;
 
         // Polygon shader
-        const char* delaunay_2_5D_vertex_shader_path = DELAUNAY_2_5D_VS.string().c_str();
-        const char* delaunay_2_5D_shader_path = DELAUNAY_2_5D_FS.string().c_str();
-        m_delaunay_shader = new Shader(delaunay_2_5D_vertex_shader_path, delaunay_2_5D_shader_path);
+        m_delaunay_shader = get_shader(DELAUNAY_2_5D_VS, DELAUNAY_2_5D_FS);
 
         // 
 
@@ -85,16 +87,16 @@ public:
     }
 
     // Draw a lat/lon contour to project it on a WGS84 sphere in a 3D scene
+    // The contours are only needed to triangulate, pass them with std::move when the caller no longer needs them
     Delaunay2_5D(std::vector<ConstrainedDelaunayContourEdges> contour_edges, float delta_lon, float delta_lat, double altitude,
-                 Color fill_color = Color::RED, bool include_wireframe = true, bool contains_holes = false)
+                 Color fill_color = Color::RED, bool include_wireframe = true, bool contains_holes = false,
+                 Retention retention = Retention::DROP_AFTER_UPLOAD)
     {
         fill_color_ = fill_color;
         include_wireframe_ = include_wireframe;
 
         // Polygon shader
-        const char* delaunay_2_5D_vertex_shader_path = DELAUNAY_2_5D_VS.string().c_str();
-        const char* delaunay_2_5D_shader_path = DELAUNAY_2_5D_FS.string().c_str();
-        m_delaunay_shader = new Shader(delaunay_2_5D_vertex_shader_path, delaunay_2_5D_shader_path);
+        m_delaunay_shader = get_shader(DELAUNAY_2_5D_VS, DELAUNAY_2_5D_FS);
 
         // Draw 2D Lat/Lon surface on a 3D WGS84 Ellipsoid
         // Create steiners points
@@ -138,18 +140,19 @@ public:
         // Setup buffer data
         initializeOpenGLFunctions();   // Initialise current context  (required)
         setup();
-    }
 
-    ~Delaunay2_5D() {
-        // delete m_outline_lines;
-        delete m_delaunay_shader;
+        vertex_count_ = vertices_.size();
+        if (retention != Retention::KEEP_ALL) {
+            release(vertices_);
+        }
     }
 
-    std::vector<CDT::Triangulation<double>> do_triangulation(std::vector<ConstrainedDelaunayContourEdges> contours)
+    std::vector<CDT::Triangulation<double>> do_triangulation(const std::vector<ConstrainedDelaunayContourEdges>& contours)
     {
+        PROFILE_SCOPE("Delaunay2_5D::do_triangulation");
         std::vector<CDT::Triangulation<double>> cdts;
 
-        for (ConstrainedDelaunayContourEdges const contour: contours)
+        for (ConstrainedDelaunayContourEdges const& contour: contours)
         {
             CDT::Triangulation<double> cdt(CDT::VertexInsertionOrder::Auto,
                                            CDT::IntersectingConstraintEdges::Resolve,
@@ -157,7 +160,7 @@ public:
             std::vector<CDT::V2d<double>> vertices;
             std::vector<CDT::Edge> edges;
 
-            std::vector<std::vector<std::pair<double, double>>> contour_edges = contour.closed_contours;
+            const std::vector<std::vector<std::pair<double, double>>>& contour_edges = contour.closed_contours;
             int index_number = 0;
 
             for (std::vector<std::pair<double, double>> const& polyline_edge: contour_edges)
@@ -212,7 +215,7 @@ public:
                 std::cout << vertices.size() << std::endl;
             }
 
-            cdts.push_back(cdt);
+            cdts.push_back(std::move(cdt));
             
         }
 
@@ -221,18 +224,16 @@ public:
         return cdts;
     };
 
-    void setup_buffer_info(std::vector<CDT::Triangulation<double>> cdts, bool project_on_sphere, double altitude)
+    void setup_buffer_info(const std::vector<CDT::Triangulation<double>>& cdts, bool project_on_sphere, double altitude)
     {
-
-        int starting_index_number = 0;
-        std::size_t index_offset = 0;
+        PROFILE_SCOPE("Delaunay2_5D::setup_buffer_info");
 
         for (CDT::Triangulation<double> const& cdt: cdts)
         {
             std::vector<Eigen::Vector3d> transformed_vertices; 
 
-            auto triags = cdt.triangles;
-            auto vertx = cdt.vertices;
+            auto const& triags = cdt.triangles;
+            auto const& vertx = cdt.vertices;
 
             // Project vertex on 3D WGS84 sphere?
             for (auto vertex: vertx){
@@ -241,14 +242,9 @@ public:
                 transformed_vertices.push_back(ecef_point);
             }
 
-            std::size_t i = 0;
-            
-            // std::cout << starting_index_number << std::endl;
-            for (auto triangle: triags)
+            // The triangles follow each other in the vertex buffer, one glDrawArrays draws them all
+            for (auto const& triangle: triags)
             {
-                element_vertex_count_[index_offset + i] = (GLsizei)triangle.vertices.size();
-                elements_start_indexes_[index_offset + i] += static_cast<GLuint>(starting_index_number + i*triangle.vertices.size());
-                
                 for (auto vertex_index: triangle.vertices)
                 {
                     Eigen::Vector3d coordinate = transformed_vertices[vertex_index];
@@ -263,13 +259,9 @@ public:
                     vertices_.push_back(vertex);
                 }
 
-                i++;
                 triangles_count_ += 1;
                 
             }
-
-            index_offset += i;
-            starting_index_number += i*3;
             
         }
 
@@ -277,14 +269,17 @@ public:
     
     void setup()
     {
+        bounds_ = vertex_bounds(vertices_);
+        center_ = bounds_.box.center();
+
         // Create the buffers and array:
         glGenVertexArrays(1, &vao_);
         glGenBuffers(1, &vbo_);
 
-        glBindVertexArray(vao_);  
+        gl_state().bind_vertex_array(vao_);  
 
         // load data into buffers
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(SimpleVertex), &vertices_[0], GL_STATIC_DRAW);  
 
         // set the vertex attribute pointers:
@@ -293,51 +288,80 @@ public:
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SimpleVertex), (void*)0);
     }
 
-    void draw(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f))
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix)
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw();
+    }
+
+    // Draw using the camera matrices of the shared CameraBlock uniform buffer
+    void draw()
     {
         m_delaunay_shader->use();  // Bind shader
 
         // Set the uniforms:
         glm::vec4 ourcolor = get_color(fill_color_);  // get the color
         m_delaunay_shader->setVec4("ourColor", ourcolor); // Set uniform
-        m_delaunay_shader->setMat4("view", view_matrix);
-        m_delaunay_shader->setMat4("projection", projection_matrix);
     
         // Draw polygons
-        glEnable(GL_MULTISAMPLE);  // Antialiasing
-        // glEnable(GL_CULL_FACE); 
-        glBindVertexArray(vao_);
-
-        glEnable(GL_POLYGON_OFFSET_FILL);
-        glPolygonOffset(1.0, 1.0f); // move polygon backward
-        glMultiDrawArrays(GL_TRIANGLES, elements_start_indexes_, element_vertex_count_, triangles_count_); //
-        glDisable(GL_POLYGON_OFFSET_FILL);
+        gl_state().enable(GL_MULTISAMPLE);  // Antialiasing
+        gl_state().disable(GL_CULL_FACE);
+        gl_state().disable(GL_BLEND);
+        gl_state().polygon_mode(GL_FILL);
+        gl_state().bind_vertex_array(vao_);
+
+        gl_state().enable(GL_POLYGON_OFFSET_FILL);
+        gl_state().polygon_offset(1.0f, 1.0f); // move polygon backward
+        glDrawArrays(GL_TRIANGLES, 0, vertex_count_);
+        gl_state().count_draw();
+        gl_state().disable(GL_POLYGON_OFFSET_FILL);
         
         if (include_wireframe_) {
             // Turn on wireframe mode
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            gl_state().polygon_mode(GL_LINE);
             m_delaunay_shader->setVec4("ourColor", get_color(Color::BLACK));
-            glMultiDrawArrays(GL_TRIANGLES, elements_start_indexes_, element_vertex_count_, triangles_count_); //
-            // Turn off wireframe mode
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            glDrawArrays(GL_TRIANGLES, 0, vertex_count_);
+            gl_state().count_draw();
+            // Turn off wireframe mode (the other layers don't declare a polygon mode)
+            gl_state().polygon_mode(GL_FILL);
         }
+    }
+
+    // Queue the draw, sorted with the other opaque layers by program and distance to the camera
+    void submit(RenderQueue& queue)
+    {
+        if (!queue.visible(bounds_))
+            return;
+        queue.submit(RenderPass::OPAQUE, "delaunay", m_delaunay_shader->ID, 0, center_, [this]() { draw(); });
+    }
 
-        // glDisable(GL_CULL_FACE); 
-        glBindVertexArray(0);  // Unbind vao
+    // Model space box and sphere, tested against the view frustum before submitting
+    const Bounds& bounds() const
+    {
+        return bounds_;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(vertices_);
+        usage.gpu_bytes = vertex_count_*sizeof(SimpleVertex);
+        return usage;
     }
 
 private:
     Color fill_color_ = Color::GREEN;
     Color linecolor_ = Color::BLUE;
     float linewidth_ = DEFAULT_LINE_WIDTH;
-    std::vector<std::vector<Eigen::Vector3f>> polygons_;
     GLuint triangles_count_ = 0;
-    GLsizei elements_start_indexes_[MAX_FEATURES];
-    GLsizei element_vertex_count_[MAX_FEATURES];
-    std::vector<SimpleVertex> vertices_;
+    std::vector<SimpleVertex> vertices_;  // empty after setup() unless Retention::KEEP_ALL
+    std::size_t vertex_count_ = 0;
+    Bounds bounds_;
+    glm::vec3 center_ = glm::vec3(0.0f);  // sort position in the render queue
     unsigned int vao_, vbo_;
     
-    Shader* m_delaunay_shader;
+    std::shared_ptr<Shader> m_delaunay_shader;
     Line* outline_lines_ptr;
 
     bool include_wireframe_ = false;
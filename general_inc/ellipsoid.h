@@ -13,6 +13,12 @@
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/profiler.h>
+#include <general_inc/utilities.h>
+
 // constants //////////////////////////////////////////////////////////////////
 const int MIN_SECTOR_COUNT = 3;
 const int MIN_STACK_COUNT  = 2;
@@ -21,12 +27,12 @@ class Ellipsoid: protected QOpenGLFunctions_3_3_Core
 {
  public:
 
-    Ellipsoid(glm::vec3 radius_abc, int sectors, int stacks, Color fill_color = Color::BLUE)
+    // Picking is analytic (see test_ray_tracing), only Retention::KEEP_ALL keeps the vertices and indices
+    Ellipsoid(glm::vec3 radius_abc, int sectors, int stacks, Color fill_color = Color::BLUE,
+              Retention retention = Retention::DROP_AFTER_UPLOAD)
     {
-        // Ellipsoid shader
-        const char* ellipsoid_vertex_shader_path = ELLIPSOID_VS.string().c_str();
-        const char* ellipsoid_fragment_shader_path = ELLIPSOID_FS.string().c_str();
-        ellipsoid_shader_ = new Shader(ellipsoid_vertex_shader_path, ellipsoid_fragment_shader_path);
+        // Ellipsoid shader (shared between all ellipsoids)
+        ellipsoid_shader_ = get_shader(ELLIPSOID_VS, ELLIPSOID_FS);
 
         // First and last element of contour may be 
         fill_color_ = fill_color;
@@ -39,9 +45,16 @@ class Ellipsoid: protected QOpenGLFunctions_3_3_Core
             sector_count_ = MIN_STACK_COUNT;
 
         build_vertices_smooth();  // Build vertices and index array
+        bounds_.box.extend(-radius_abc_);
+        bounds_.box.extend(radius_abc_);
+        bounds_.sphere = {glm::vec3(0.0f), std::max({radius_abc_.x, radius_abc_.y, radius_abc_.z})};
 
         initializeOpenGLFunctions();   // Initialise current context  (required)
         setup();  // Setup buffer data for openGL
+
+        if (retention != Retention::KEEP_ALL) {
+            clear_arrays();
+        }
     }
 
     void setup()
@@ -51,15 +64,20 @@ class Ellipsoid: protected QOpenGLFunctions_3_3_Core
         glGenBuffers(1, &vbo_);
         glGenBuffers(1, &ebo_);
 
-        glBindVertexArray(vao_);  
+        gl_state().bind_vertex_array(vao_);  
 
         // load vertex data into buffer
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(SimpleVertex), &vertices_[0], GL_STATIC_DRAW);  
 
-        // load index data into element buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size()*sizeof(unsigned int), &indices_[0], GL_STATIC_DRAW);
+        // load index data into element buffer, the faces followed by the outline
+        triangle_index_count_ = indices_.size();
+        line_index_count_ = line_indices_.size();
+        gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (triangle_index_count_ + line_index_count_)*sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, triangle_index_count_*sizeof(unsigned int), indices_.data());
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangle_index_count_*sizeof(unsigned int), line_index_count_*sizeof(unsigned int), line_indices_.data());
+        vertex_count_ = vertices_.size();
 
         // set the vertex attribute pointers:
         // vertex Positions
@@ -75,36 +93,40 @@ class Ellipsoid: protected QOpenGLFunctions_3_3_Core
     // draw a sphere in VertexArray mode
     // OpenGL RC must be set before calling it
     ///////////////////////////////////////////////////////////////////////////////
-    void draw(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f), glm::mat4 model_matrix = glm::mat4(1.0f))
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix, glm::mat4 model_matrix = glm::mat4(1.0f))
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw(model_matrix);
+    }
+
+    // Draw using the camera matrices of the shared CameraBlock uniform buffer
+    void draw(glm::mat4 model_matrix = glm::mat4(1.0f))
     {
         ellipsoid_shader_->use();  // Bind shader
 
         // Set the uniforms:
         glm::vec4 ourcolor = get_color(fill_color_);  // get the color
         ellipsoid_shader_->setVec4("ourColor", ourcolor); // Set uniform
-        ellipsoid_shader_->setMat4("view", view_matrix);
-        ellipsoid_shader_->setMat4("projection", projection_matrix);
         ellipsoid_shader_->setMat4("model", model_matrix);
     
         // Draw triangles
         //glEnable(GL_MULTISAMPLE);  // Antialiasing
-        glBindVertexArray(vao_);
-
-        // Draw ellipsoid
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size()*sizeof(unsigned int), &indices_[0], GL_STATIC_DRAW);
+        gl_state().disable(GL_CULL_FACE);
+        gl_state().disable(GL_BLEND);
+        gl_state().bind_vertex_array(vao_);
 
-        glEnable(GL_POLYGON_OFFSET_FILL);
-        glPolygonOffset(1.0, 1.0f); // move polygon backward
-        glDrawElements(GL_TRIANGLES, (unsigned int)indices_.size(), GL_UNSIGNED_INT, 0);  // Set element buffer for triangle faces
-        glDisable(GL_POLYGON_OFFSET_FILL);
+        // Draw faces
+        gl_state().enable(GL_POLYGON_OFFSET_FILL);
+        gl_state().polygon_offset(1.0f, 1.0f); // move polygon backward
+        glDrawElements(GL_TRIANGLES, (GLsizei)triangle_index_count_, GL_UNSIGNED_INT, 0);
+        gl_state().count_draw();
+        gl_state().disable(GL_POLYGON_OFFSET_FILL);
 
         // Draw lines
         ellipsoid_shader_->setVec4("ourColor", glm::vec4(1.0f)); // Set uniform
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, line_indices_.size()*sizeof(unsigned int), &line_indices_[0], GL_STATIC_DRAW);  // Update element buffer
-        // for lines
-        glDrawElements(GL_LINES, (unsigned int)line_indices_.size(), GL_UNSIGNED_INT, 0);
-
-        glBindVertexArray(0);  // Unbind vao
+        glDrawElements(GL_LINES, (GLsizei)line_index_count_, GL_UNSIGNED_INT, (void*)(triangle_index_count_*sizeof(unsigned int)));
+        gl_state().count_draw();
     }
 
     // ray_ndc: incoming ray in normalised device coordinates
@@ -114,6 +136,7 @@ class Ellipsoid: protected QOpenGLFunctions_3_3_Core
         glm::vec4 ray_world_direction,     // Ray direction (NOT target position!), in world space. Must be normalize()'d.
         glm::mat4 model_matrix
     ){
+        PROFILE_SCOPE("Ellipsoid::test_ray_tracing");
         // Compute translation matrix
         glm::mat4 T = glm::mat4(1.0f);
         T[3].x = model_matrix[3].x;  // Third column
@@ -211,6 +234,31 @@ class Ellipsoid: protected QOpenGLFunctions_3_3_Core
 
     }
 
+    // Queue the draw, the ellipsoid center is placed by the model matrix (kept by the queue, the closure
+    // stays small enough for std::function not to allocate)
+    void submit(RenderQueue& queue, glm::mat4 model_matrix = glm::mat4(1.0f))
+    {
+        if (!queue.visible(bounds_, model_matrix))
+            return;
+        glm::vec3 position = glm::vec3(model_matrix * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        queue.submit(RenderPass::OPAQUE, "ellipsoids", ellipsoid_shader_->ID, 0, position, model_matrix,
+                     [this](const DrawParameters& parameters) { draw(parameters.matrices[0]); });
+    }
+
+    // Model space box and sphere, tested against the view frustum before submitting
+    const Bounds& bounds() const
+    {
+        return bounds_;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(vertices_) + heap_bytes(indices_) + heap_bytes(line_indices_);
+        usage.gpu_bytes = vertex_count_*sizeof(SimpleVertex) + (triangle_index_count_ + line_index_count_)*sizeof(unsigned int);
+        return usage;
+    }
+
  private: 
     ///////////////////////////////////////////////////////////////////////////////
     // dealloc vectors
@@ -322,10 +370,14 @@ class Ellipsoid: protected QOpenGLFunctions_3_3_Core
     glm::vec3 radius_abc_;
     int sector_count_;                        // longitude, # of slices
     int stack_count_;                         // latitude, # of stacks
-    std::vector<SimpleVertex> vertices_;
-    std::vector<unsigned int> indices_;
-    std::vector<unsigned int> line_indices_;
+    std::vector<SimpleVertex> vertices_;      // empty after setup() unless Retention::KEEP_ALL
+    std::vector<unsigned int> indices_;       // triangles
+    std::vector<unsigned int> line_indices_;  // wireframe
+    std::size_t vertex_count_ = 0;
+    Bounds bounds_;
+    std::size_t triangle_index_count_ = 0;   // line indices follow the triangle ones in ebo_
+    std::size_t line_index_count_ = 0;
     
-    Shader* ellipsoid_shader_;
+    std::shared_ptr<Shader> ellipsoid_shader_;
     Color fill_color_ = Color::BLUE;
 };
\ No newline at end of file
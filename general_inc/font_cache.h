@@ -0,0 +1,627 @@
+#ifndef FONT_CACHE_H
+#define FONT_CACHE_H
+
+#include <glm/glm.hpp>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <general_inc/gl_state.h>
+#include <general_inc/glyph_atlas.h>
+#include <general_inc/glyph_sdf.h>
+#include <general_inc/paths.h>
+#include <general_inc/profiler.h>
+#include <general_inc/utilities.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/// Holds all state information relevant to a character as loaded using FreeType
+struct Character {
+    glm::vec2    UVMin;     // Top left of the glyph in the atlas texture
+    glm::vec2    UVMax;     // Bottom right of the glyph in the atlas texture
+    glm::ivec2   Size;      // Size of glyph
+    glm::ivec2   Bearing;   // Offset from baseline to left/top of glyph
+    unsigned int Advance;   // Horizontal offset to advance to next glyph
+};
+
+/// What the atlas stores: glyph coverage (sharp at the baked size only) or signed distances to
+// the outline (sharp at any size, with outlines and halos, see glyph_sdf.h and text.fs)
+enum class GlyphRendering: std::uint32_t { BITMAP = 0, SDF = 1 };
+
+const unsigned int FONT_GLYPH_COUNT = 128;     // the ASCII set
+const unsigned int GLYPH_PIXEL_SIZE = 48;      // height the bitmap glyphs are rasterised at [px]
+const unsigned int SDF_GLYPH_PIXEL_SIZE = 32;  // height of the distance field glyphs in the atlas [px]
+const int SDF_SUPERSAMPLE = 4;                 // distance field glyphs are rasterised this many times larger
+const int SDF_SPREAD = 4;                      // distances stored up to this far from the outline [atlas px]
+const int GLYPH_ATLAS_WIDTH = 512;             // [px], the height is the next power of two that fits
+const int GLYPH_ATLAS_PADDING = 1;             // empty pixels around each glyph so linear filtering doesn't bleed
+const int GLYPH_PAGE_COUNT = 8;                // pages of glyphs rasterised on demand, below the ASCII set
+const int GLYPH_PAGE_HEIGHT = 128;             // [px], pages are GLYPH_ATLAS_WIDTH wide
+static_assert(GLYPH_PAGE_COUNT <= 32, "pages are tracked in 32 bit masks");
+
+// Rasterises one glyph of the face (at supersample times the atlas size for distance fields, see
+// FT_Set_Pixel_Sizes), false if FreeType can't load it. advance is in 1/64 atlas pixels.
+bool rasterize_glyph(FT_Face face, char32_t code, GlyphRendering rendering, GlyphBitmap& glyph, unsigned int& advance)
+{
+    if (FT_Load_Char(face, code, FT_LOAD_RENDER))
+    {
+        std::cout << "ERROR::FREETYTPE: Failed to load Glyph " << static_cast<std::uint32_t>(code) << std::endl;
+        return false;
+    }
+    const FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap& bitmap = slot->bitmap;
+    const int supersample = rendering == GlyphRendering::SDF ? SDF_SUPERSAMPLE : 1;
+    if (rendering == GlyphRendering::SDF)
+    {
+        glyph = make_sdf_glyph(bitmap.buffer, static_cast<int>(bitmap.width), static_cast<int>(bitmap.rows), bitmap.pitch,
+                               slot->bitmap_left, slot->bitmap_top, supersample, SDF_SPREAD);
+    }
+    else
+    {
+        glyph.width = static_cast<int>(bitmap.width);
+        glyph.rows = static_cast<int>(bitmap.rows);
+        glyph.bearing = glm::ivec2(slot->bitmap_left, slot->bitmap_top);
+        glyph.pixels.resize(std::size_t(glyph.width)*glyph.rows);
+        for (int row = 0; row < glyph.rows; row++) {
+            std::memcpy(glyph.pixels.data() + row*glyph.width, bitmap.buffer + row*bitmap.pitch, glyph.width);
+        }
+    }
+    advance = static_cast<unsigned int>(slot->advance.x/supersample);
+    return true;
+}
+
+/// The glyphs of a font file at one pixel size, in one GL_RED atlas texture: the ASCII set baked
+// by the FontCache at the top, then GLYPH_PAGE_COUNT pages where any other code point is
+// rasterised on first use. When the pages are full the least recently used one is emptied, and
+// evictions() tells the texts their quads may point at glyphs that are gone. A glyph that found
+// no room (overflows()) is worth asking for again next frame.
+class Font: protected QOpenGLFunctions_3_3_Core
+{
+public:
+    std::string path;
+    unsigned int pixel_size = GLYPH_PIXEL_SIZE;
+    GlyphRendering rendering = GlyphRendering::BITMAP;
+    float spread = 0.0f;  // distance from the outline to 0 and 1 in the atlas, SDF only [px]
+    Character characters[FONT_GLYPH_COUNT] = {};
+    GLuint atlas_texture = 0;
+    int atlas_width = 0;   // [px]
+    int atlas_height = 0;  // [px]
+    int baked_height = 0;  // rows of the ASCII set, the pages start below [px]
+
+    Font()
+        : pages_(GLYPH_PAGE_COUNT, GLYPH_ATLAS_WIDTH, GLYPH_PAGE_HEIGHT, GLYPH_ATLAS_PADDING)
+    {
+        initializeOpenGLFunctions();   // Initialise current context  (required)
+    }
+
+    ~Font()
+    {
+        if (face_) { FT_Done_Face(face_); }
+        if (library_) { FT_Done_FreeType(library_); }
+    }
+
+    Font(const Font&) = delete;
+    Font& operator=(const Font&) = delete;
+
+    // Rasterises the glyph the first time it is asked for. Glyphs that don't fit (every page used
+    // this frame) or that the font can't load have no size and no advance. The bit of the glyph's
+    // page is set in pages, for touch().
+    const Character& character(char32_t code, std::uint32_t* pages = nullptr)
+    {
+        if (code < FONT_GLYPH_COUNT) { return characters[code]; }
+        std::uint32_t slot;
+        if (table_.find(code, slot))
+        {
+            statistics_.hits++;
+            use(glyphs_[slot].page, pages);
+            return glyphs_[slot].character;
+        }
+        statistics_.misses++;
+        return load(code, pages);
+    }
+
+    // Marks the pages a text draws from as used this frame, so they aren't evicted under it
+    void touch(std::uint32_t pages)
+    {
+        pages_.touch_mask(pages, frame_);
+    }
+
+    void begin_frame()
+    {
+        frame_++;
+    }
+
+    // Grows whenever a page is emptied, quads built before then must be rebuilt
+    std::size_t evictions() const
+    {
+        return statistics_.evictions;
+    }
+
+    // Grows whenever a glyph is left out for lack of room, quads built meanwhile are incomplete
+    std::size_t overflows() const
+    {
+        return statistics_.overflows;
+    }
+
+    GlyphCacheStatistics statistics() const
+    {
+        GlyphCacheStatistics statistics = statistics_;
+        statistics.resident = table_.size();
+        return statistics;
+    }
+
+private:
+    struct Glyph {
+        Character character;
+        int page;  // -1 for blank glyphs (space), which take no room in the atlas
+    };
+
+    static const Character& missing()
+    {
+        static const Character character = {};
+        return character;
+    }
+
+    void use(int page, std::uint32_t* pages)
+    {
+        if (page < 0) { return; }
+        pages_.touch(page, frame_);
+        if (pages) { *pages |= 1u << page; }
+    }
+
+    // The face stays open for the glyphs still to come, at the size the ASCII set was baked at
+    bool open_face()
+    {
+        if (face_) { return true; }
+        if (face_failed_) { return false; }
+        face_failed_ = true;
+        if (FT_Init_FreeType(&library_))
+        {
+            std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+            library_ = nullptr;
+            return false;
+        }
+        if (FT_New_Face(library_, path.c_str(), 0, &face_))
+        {
+            std::cout << "ERROR::FREETYPE: Failed to load font " << path << std::endl;
+            face_ = nullptr;
+            return false;
+        }
+        const unsigned int supersample = rendering == GlyphRendering::SDF ? SDF_SUPERSAMPLE : 1;
+        FT_Set_Pixel_Sizes(face_, 0, pixel_size*supersample);
+        face_failed_ = false;
+        return true;
+    }
+
+    const Character& load(char32_t code, std::uint32_t* pages)
+    {
+        PROFILE_SCOPE("Font::load (FreeType)");
+        GlyphBitmap bitmap;
+        unsigned int advance = 0;
+        if (atlas_texture == 0 || !open_face() || !rasterize_glyph(face_, code, rendering, bitmap, advance))
+            return missing();
+
+        Glyph glyph = {{glm::vec2(0.0f), glm::vec2(0.0f), glm::ivec2(bitmap.width, bitmap.rows), bitmap.bearing, advance}, -1};
+        if (bitmap.width > 0 && bitmap.rows > 0)
+        {
+            GlyphAllocation allocation = pages_.allocate(bitmap.width, bitmap.rows, frame_);
+            if (allocation.page < 0)
+            {
+                statistics_.overflows++;
+                return missing();
+            }
+            if (allocation.evicted) { evict(allocation); }
+
+            const glm::ivec2 position = allocation.position + glm::ivec2(0, page_top(allocation.page));
+            gl_state().bind_texture(0, GL_TEXTURE_2D, atlas_texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, position.x, position.y, bitmap.width, bitmap.rows, GL_RED, GL_UNSIGNED_BYTE, bitmap.pixels.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glyph.character.UVMin = glm::vec2(float(position.x)/atlas_width, float(position.y)/atlas_height);
+            glyph.character.UVMax = glm::vec2(float(position.x + bitmap.width)/atlas_width, float(position.y + bitmap.rows)/atlas_height);
+            glyph.page = allocation.page;
+            pages_.add(allocation.page, code);
+        }
+
+        std::uint32_t slot;
+        if (free_slots_.empty())
+        {
+            slot = static_cast<std::uint32_t>(glyphs_.size());
+            glyphs_.push_back(glyph);
+        }
+        else
+        {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+            glyphs_[slot] = glyph;
+        }
+        table_.insert(code, slot);
+        use(glyph.page, pages);
+        return glyphs_[slot].character;
+    }
+
+    // Forgets the glyphs of the emptied page and clears its pixels, stale borders would bleed into the new glyphs
+    void evict(const GlyphAllocation& allocation)
+    {
+        for (char32_t code: allocation.evicted_codes) {
+            std::uint32_t slot;
+            if (table_.erase(code, slot)) { free_slots_.push_back(slot); }
+        }
+        statistics_.evictions++;
+        const std::vector<unsigned char> blank(std::size_t(atlas_width)*GLYPH_PAGE_HEIGHT, 0);
+        gl_state().bind_texture(0, GL_TEXTURE_2D, atlas_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, page_top(allocation.page), atlas_width, GLYPH_PAGE_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, blank.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    int page_top(int page) const
+    {
+        return baked_height + page*GLYPH_PAGE_HEIGHT;
+    }
+
+    GlyphTable table_;                        // code point -> slot in glyphs_
+    std::deque<Glyph> glyphs_;                // a deque so the references handed out survive new glyphs
+    std::vector<std::uint32_t> free_slots_;   // of evicted glyphs
+    GlyphPages pages_;
+    std::uint64_t frame_ = 1;
+    GlyphCacheStatistics statistics_;
+    FT_Library library_ = nullptr;
+    FT_Face face_ = nullptr;
+    bool face_failed_ = false;
+};
+
+const char FONT_CACHE_MAGIC[8] = {'G', 'L', 'Q', 'F', 'O', 'N', 'T', '\0'};
+const std::uint32_t FONT_CACHE_VERSION = 2;  // bump when the file layout or the atlas packing changes
+
+/// Baked atlas of a font, so later launches skip FreeType.
+// Layout (native endianness): FontCacheHeader, FontCacheGlyph [glyph_count], atlas pixels (one
+// byte each, rows top to bottom).
+struct FontCacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t pixel_size;
+    std::uint64_t source_key;  // font_cache_key of the font file when the atlas was baked
+    std::uint32_t glyph_count;
+    std::uint32_t atlas_width;
+    std::uint32_t atlas_height;
+    std::uint32_t rendering;  // GlyphRendering
+};
+
+struct FontCacheGlyph {
+    float uv_min[2];
+    float uv_max[2];
+    std::int32_t size[2];
+    std::int32_t bearing[2];
+    std::uint32_t advance;
+    std::uint32_t reserved;
+};
+
+/// Hash of the font file, the pixel size, the rendering and the atlas layout, 0 if the font can't be read
+std::uint64_t font_cache_key(const std::string& font_path, unsigned int pixel_size, GlyphRendering rendering)
+{
+    std::ifstream file(font_path, std::ios::binary);
+    if (!file.is_open()) { return 0; }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    const std::uint32_t layout[] = {FONT_CACHE_VERSION, pixel_size, static_cast<std::uint32_t>(rendering), FONT_GLYPH_COUNT,
+                                    GLYPH_ATLAS_WIDTH, GLYPH_ATLAS_PADDING, SDF_SUPERSAMPLE, SDF_SPREAD};
+    std::uint64_t key = hash_bytes(layout, sizeof(layout));
+    return hash_bytes(bytes.data(), bytes.size(), key);
+}
+
+/// Process-wide cache of glyph atlases keyed by (font file, pixel size, rendering).
+// The first acquire() of a font reads its atlas from the cache directory, or rasterises the glyphs
+// with FreeType, packs them and writes the atlas there. Every Text3D then shares the Font and its
+// texture, which live as long as the GL context.
+class FontCache: protected QOpenGLFunctions_3_3_Core
+{
+public:
+    static FontCache& instance()
+    {
+        static FontCache cache;
+        return cache;
+    }
+
+    // Directory of the baked atlases (empty disables it, FreeType then runs on every launch)
+    static void set_cache_directory(const std::string& directory)
+    {
+        cache_directory_ = directory;
+    }
+
+    // pixel_size 0 picks GLYPH_PIXEL_SIZE for bitmaps and SDF_GLYPH_PIXEL_SIZE for distance fields
+    Font& acquire(const std::string& font_path, GlyphRendering rendering = GlyphRendering::BITMAP, unsigned int pixel_size = 0)
+    {
+        if (pixel_size == 0)
+            pixel_size = rendering == GlyphRendering::SDF ? SDF_GLYPH_PIXEL_SIZE : GLYPH_PIXEL_SIZE;
+        auto key = std::make_tuple(canonical_path(font_path), pixel_size, rendering);
+        auto entry = fonts_.find(key);
+        if (entry != fonts_.end())
+        {
+            hits_++;
+            return *entry->second;
+        }
+
+        std::unique_ptr<Font> font = std::make_unique<Font>();
+        font->path = std::get<0>(key);
+        font->pixel_size = pixel_size;
+        font->rendering = rendering;
+        font->spread = rendering == GlyphRendering::SDF ? float(SDF_SPREAD) : 0.0f;
+        std::vector<unsigned char> pixels;
+        std::uint64_t source_key = cache_directory_.empty() ? 0 : font_cache_key(font->path, pixel_size, rendering);
+        if (source_key != 0 && read_cache(cache_path(*font), source_key, *font, pixels))
+        {
+            cache_loads_++;
+        }
+        else if (bake(*font, pixels))
+        {
+            bakes_++;
+            if (source_key != 0)
+                write_cache(cache_path(*font), source_key, *font, pixels);
+        }
+        upload(*font, pixels);
+        return *fonts_.emplace(key, std::move(font)).first->second;
+    }
+
+    // Starts a frame for the page eviction of every font
+    void begin_frame()
+    {
+        for (auto& font: fonts_) { font.second->begin_frame(); }
+    }
+
+    // Glyphs rasterised on demand, all fonts together
+    GlyphCacheStatistics glyph_statistics() const
+    {
+        GlyphCacheStatistics statistics;
+        for (auto const& font: fonts_) { statistics += font.second->statistics(); }
+        return statistics;
+    }
+
+    void print_statistics() const
+    {
+        std::cout << "Font cache: " << fonts_.size() << " fonts (" << cache_loads_ << " from disk, " << bakes_
+                  << " rasterised), " << hits_ << " shared" << std::endl;
+        print_glyph_statistics();
+    }
+
+    void print_glyph_statistics() const
+    {
+        GlyphCacheStatistics glyphs = glyph_statistics();
+        std::cout << "Glyph cache: " << glyphs.resident << " glyphs, " << glyphs.hits << " hits, " << glyphs.misses
+                  << " misses (hit rate " << glyphs.hit_rate() << "), " << glyphs.evictions << " page evictions, "
+                  << glyphs.overflows << " not drawn" << std::endl;
+    }
+
+private:
+    FontCache()
+    {
+        initializeOpenGLFunctions();   // Initialise current context  (required)
+    }
+
+    FontCache(const FontCache&) = delete;
+    FontCache& operator=(const FontCache&) = delete;
+
+    static std::string cache_path(const Font& font)
+    {
+        std::stringstream file_name;
+        file_name << std::hex << std::setw(16) << std::setfill('0') << hash_bytes(font.path.data(), font.path.size())
+                  << std::dec << "_" << font.pixel_size << (font.rendering == GlyphRendering::SDF ? "_sdf" : "") << ".font";
+        return (fs::path(cache_directory_) / file_name.str()).string();
+    }
+
+    // Rasterises the ASCII set (as distance fields for GlyphRendering::SDF) and packs it in rows (shelves) of one atlas
+    bool bake(Font& font, std::vector<unsigned char>& pixels)
+    {
+        PROFILE_SCOPE("FontCache::bake (FreeType)");
+        // FreeType
+        // --------
+        FT_Library ft;
+        // All functions return a value different than 0 whenever an error occurred
+        if (FT_Init_FreeType(&ft))
+        {
+            std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+            return false;
+        }
+
+        // load font as face
+        FT_Face face;
+        if (FT_New_Face(ft, font.path.c_str(), 0, &face)) {
+            std::cout << "ERROR::FREETYPE: Failed to load font " << font.path << std::endl;
+            FT_Done_FreeType(ft);
+            return false;
+        }
+        // set size to load glyphs as
+        const int supersample = font.rendering == GlyphRendering::SDF ? SDF_SUPERSAMPLE : 1;
+        FT_Set_Pixel_Sizes(face, 0, font.pixel_size*supersample);
+
+        std::vector<GlyphBitmap> bitmaps(FONT_GLYPH_COUNT);
+        for (unsigned char c = 0; c < FONT_GLYPH_COUNT; c++)
+        {
+            // Load character glyph
+            unsigned int advance = 0;
+            if (!rasterize_glyph(face, c, font.rendering, bitmaps[c], advance))
+                continue;
+            const GlyphBitmap& glyph = bitmaps[c];
+            // texture coordinates once the atlas size is known
+            font.characters[c] = {
+                glm::vec2(0.0f),
+                glm::vec2(0.0f),
+                glm::ivec2(glyph.width, glyph.rows),
+                glyph.bearing,
+                advance
+            };
+        }
+        // destroy FreeType once we're finished
+        FT_Done_Face(face);
+        FT_Done_FreeType(ft);
+
+        // shelves of glyphs, top to bottom
+        std::vector<glm::ivec2> positions(FONT_GLYPH_COUNT);
+        int shelf_x = GLYPH_ATLAS_PADDING, shelf_y = GLYPH_ATLAS_PADDING, shelf_height = 0;
+        for (unsigned int c = 0; c < FONT_GLYPH_COUNT; c++)
+        {
+            if (shelf_x + bitmaps[c].width + GLYPH_ATLAS_PADDING > GLYPH_ATLAS_WIDTH)  // next shelf
+            {
+                shelf_x = GLYPH_ATLAS_PADDING;
+                shelf_y += shelf_height + GLYPH_ATLAS_PADDING;
+                shelf_height = 0;
+            }
+            positions[c] = glm::ivec2(shelf_x, shelf_y);
+            shelf_x += bitmaps[c].width + GLYPH_ATLAS_PADDING;
+            shelf_height = std::max(shelf_height, bitmaps[c].rows);
+        }
+
+        font.atlas_width = GLYPH_ATLAS_WIDTH;
+        font.atlas_height = 1;
+        while (font.atlas_height < shelf_y + shelf_height + GLYPH_ATLAS_PADDING) { font.atlas_height *= 2; }
+        pixels.assign(std::size_t(font.atlas_width)*font.atlas_height, 0);
+        for (unsigned int c = 0; c < FONT_GLYPH_COUNT; c++)
+        {
+            const GlyphBitmap& glyph = bitmaps[c];
+            const glm::ivec2 position = positions[c];
+            for (int row = 0; row < glyph.rows; row++) {
+                std::memcpy(&pixels[std::size_t(position.y + row)*font.atlas_width + position.x],
+                            glyph.pixels.data() + row*glyph.width, glyph.width);
+            }
+            Character& character = font.characters[c];
+            character.UVMin = glm::vec2(float(position.x)/font.atlas_width, float(position.y)/font.atlas_height);
+            character.UVMax = glm::vec2(float(position.x + glyph.width)/font.atlas_width,
+                                        float(position.y + glyph.rows)/font.atlas_height);
+        }
+        return true;
+    }
+
+    // The baked ASCII set at the top of the texture, the (empty) pages of the on-demand glyphs below
+    void upload(Font& font, const std::vector<unsigned char>& pixels)
+    {
+        if (pixels.empty())
+            return;  // the font failed to load, text using it draws nothing
+        font.baked_height = font.atlas_height;
+        font.atlas_height = font.baked_height + GLYPH_PAGE_COUNT*GLYPH_PAGE_HEIGHT;
+        const float v_scale = float(font.baked_height)/font.atlas_height;
+        for (Character& character: font.characters) {
+            character.UVMin.y *= v_scale;
+            character.UVMax.y *= v_scale;
+        }
+        std::vector<unsigned char> atlas(pixels);
+        atlas.resize(std::size_t(font.atlas_width)*font.atlas_height, 0);
+
+        glGenTextures(1, &font.atlas_texture);
+        gl_state().bind_texture(0, GL_TEXTURE_2D, font.atlas_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // disable byte-alignment restriction
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, font.atlas_width, font.atlas_height, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // set texture options
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    static bool read_cache(const std::string& path, std::uint64_t source_key, Font& font, std::vector<unsigned char>& pixels)
+    {
+        PROFILE_SCOPE("FontCache::read_cache");
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+        FontCacheHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, FONT_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != FONT_CACHE_VERSION ||
+            header.source_key != source_key || header.pixel_size != font.pixel_size || header.glyph_count != FONT_GLYPH_COUNT ||
+            header.rendering != static_cast<std::uint32_t>(font.rendering) ||
+            header.atlas_width == 0 || header.atlas_height == 0 || header.atlas_width*header.atlas_height > (1u << 26)) { return false; }
+
+        std::vector<FontCacheGlyph> glyphs(header.glyph_count);
+        pixels.resize(std::size_t(header.atlas_width)*header.atlas_height);
+        if (!file.read(reinterpret_cast<char*>(glyphs.data()), glyphs.size()*sizeof(FontCacheGlyph)) ||
+            !file.read(reinterpret_cast<char*>(pixels.data()), pixels.size()))
+        {
+            pixels.clear();
+            return false;
+        }
+        font.atlas_width = static_cast<int>(header.atlas_width);
+        font.atlas_height = static_cast<int>(header.atlas_height);
+        for (std::size_t c = 0; c < glyphs.size(); c++) {
+            const FontCacheGlyph& glyph = glyphs[c];
+            font.characters[c] = {glm::vec2(glyph.uv_min[0], glyph.uv_min[1]), glm::vec2(glyph.uv_max[0], glyph.uv_max[1]),
+                                  glm::ivec2(glyph.size[0], glyph.size[1]), glm::ivec2(glyph.bearing[0], glyph.bearing[1]),
+                                  glyph.advance};
+        }
+        return true;
+    }
+
+    // Through a temporary file so readers never see a partial atlas
+    static bool write_cache(const std::string& path, std::uint64_t source_key, const Font& font, const std::vector<unsigned char>& pixels)
+    {
+        FontCacheHeader header = {};
+        std::memcpy(header.magic, FONT_CACHE_MAGIC, sizeof(header.magic));
+        header.version = FONT_CACHE_VERSION;
+        header.pixel_size = font.pixel_size;
+        header.source_key = source_key;
+        header.glyph_count = FONT_GLYPH_COUNT;
+        header.atlas_width = static_cast<std::uint32_t>(font.atlas_width);
+        header.atlas_height = static_cast<std::uint32_t>(font.atlas_height);
+        header.rendering = static_cast<std::uint32_t>(font.rendering);
+        std::vector<FontCacheGlyph> glyphs(FONT_GLYPH_COUNT);
+        for (std::size_t c = 0; c < glyphs.size(); c++) {
+            const Character& character = font.characters[c];
+            glyphs[c] = {{character.UVMin.x, character.UVMin.y}, {character.UVMax.x, character.UVMax.y},
+                         {character.Size.x, character.Size.y}, {character.Bearing.x, character.Bearing.y}, character.Advance, 0};
+        }
+
+        try {
+            fs::create_directories(fs::path(path).parent_path());
+        }
+        catch (fs::filesystem_error& e) {
+            std::cout << "ERROR::FONT_CACHE::DIRECTORY_NOT_CREATED " << e.what() << std::endl;
+            return false;
+        }
+        std::string temporary_path = path + ".tmp";
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(glyphs.data()), glyphs.size()*sizeof(FontCacheGlyph));
+        file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+        file.close();
+        if (!file)
+        {
+            std::cout << "ERROR::FONT_CACHE::NOT_WRITTEN " << path << std::endl;
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+        try {
+            fs::rename(fs::path(temporary_path), fs::path(path));
+        }
+        catch (fs::filesystem_error& e) {
+            std::cout << "ERROR::FONT_CACHE::NOT_WRITTEN " << e.what() << std::endl;
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::map<std::tuple<std::string, unsigned int, GlyphRendering>, std::unique_ptr<Font>> fonts_;  // Text3D keeps references, entries never move
+    std::size_t hits_ = 0;
+    std::size_t bakes_ = 0;
+    std::size_t cache_loads_ = 0;
+    static inline std::string cache_directory_;
+};
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <array>
+#include <iostream>
+
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;  // texture units tracked by the cache
+
+/// Number of state changing GL calls issued and skipped, and draw calls made during a frame
+struct GLStateStatistics {
+    unsigned long issued = 0;
+    unsigned long elided = 0;
+    unsigned long draws = 0;
+};
+
+/// Thin cache over the GL state touched by the layers.
+// Every bind/enable made while rendering goes through here so calls that would not
+// change anything are skipped. Qt Quick changes state between our frames so the cache
+// has to be invalidated (begin_frame()) before it is trusted again.
+// Layers set the state they need at the start of their draw instead of restoring
+// defaults afterwards, consecutive layers needing the same state then cost nothing.
+class GLState: protected QOpenGLFunctions_3_3_Core
+{
+public:
+    static GLState& instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    // Forget all cached state and start counting a new frame
+    void begin_frame()
+    {
+        last_frame_ = frame_;
+        frame_ = GLStateStatistics();
+        invalidate();
+    }
+
+    void invalidate()
+    {
+        program_ = UNKNOWN;
+        vertex_array_ = UNKNOWN;
+        array_buffer_ = UNKNOWN;
+        element_array_buffer_ = UNKNOWN;
+        uniform_buffer_ = UNKNOWN;
+        active_texture_ = UNKNOWN;
+        for (auto& unit: textures_) { unit.fill(UNKNOWN); }
+        capabilities_.fill(-1);
+        blend_src_ = UNKNOWN;
+        blend_dst_ = UNKNOWN;
+        depth_func_ = UNKNOWN;
+        polygon_mode_ = UNKNOWN;
+        polygon_offset_known_ = false;
+    }
+
+    void use_program(GLuint program)
+    {
+        if (changed(program_, program)) { glUseProgram(program); }
+    }
+
+    void bind_vertex_array(GLuint vertex_array)
+    {
+        if (changed(vertex_array_, vertex_array))
+        {
+            glBindVertexArray(vertex_array);
+            element_array_buffer_ = UNKNOWN;  // element buffer binding is part of the vao state
+        }
+    }
+
+    void bind_buffer(GLenum target, GLuint buffer)
+    {
+        GLuint* cached = buffer_slot(target);
+        if (cached == nullptr) {
+            issued();
+            glBindBuffer(target, buffer);
+        }
+        else if (changed(*cached, buffer)) { glBindBuffer(target, buffer); }
+    }
+
+    void active_texture(GLenum unit)
+    {
+        if (changed(active_texture_, unit)) { glActiveTexture(unit); }
+    }
+
+    // Binds texture to texture unit GL_TEXTURE0 + unit (only switches the active unit if the binding changes)
+    void bind_texture(GLuint unit, GLenum target, GLuint texture)
+    {
+        int target_index = texture_target_index(target);
+        if (unit >= GL_STATE_TEXTURE_UNITS || target_index < 0)
+        {
+            active_texture(GL_TEXTURE0 + unit);
+            issued();
+            glBindTexture(target, texture);
+            return;
+        }
+        if (textures_[unit][target_index] == texture)
+        {
+            elided();
+            return;
+        }
+        active_texture(GL_TEXTURE0 + unit);
+        textures_[unit][target_index] = texture;
+        issued();
+        glBindTexture(target, texture);
+    }
+
+    void set_capability(GLenum capability, bool enabled)
+    {
+        int index = capability_index(capability);
+        if (index >= 0 && capabilities_[index] == (enabled ? 1 : 0))
+        {
+            elided();
+            return;
+        }
+        if (index >= 0) { capabilities_[index] = enabled ? 1 : 0; }
+        issued();
+        if (enabled) { glEnable(capability); }
+        else { glDisable(capability); }
+    }
+
+    void enable(GLenum capability) { set_capability(capability, true); }
+    void disable(GLenum capability) { set_capability(capability, false); }
+
+    void blend_func(GLenum source_factor, GLenum destination_factor)
+    {
+        if (blend_src_ == source_factor && blend_dst_ == destination_factor)
+        {
+            elided();
+            return;
+        }
+        blend_src_ = source_factor;
+        blend_dst_ = destination_factor;
+        issued();
+        glBlendFunc(source_factor, destination_factor);
+    }
+
+    void depth_func(GLenum function)
+    {
+        if (changed(depth_func_, function)) { glDepthFunc(function); }
+    }
+
+    void polygon_mode(GLenum mode)  // applied to GL_FRONT_AND_BACK
+    {
+        if (changed(polygon_mode_, mode)) { glPolygonMode(GL_FRONT_AND_BACK, mode); }
+    }
+
+    void polygon_offset(float factor, float units)
+    {
+        if (polygon_offset_known_ && polygon_offset_factor_ == factor && polygon_offset_units_ == units)
+        {
+            elided();
+            return;
+        }
+        polygon_offset_known_ = true;
+        polygon_offset_factor_ = factor;
+        polygon_offset_units_ = units;
+        issued();
+        glPolygonOffset(factor, units);
+    }
+
+    // Layers call this next to every glDraw* call (a multi draw counts once)
+    void count_draw() { frame_.draws++; }
+
+    // Objects deleted while cached must be forgotten as GL may hand their names out again
+    void forget_program(GLuint program)
+    {
+        if (program_ == program) { program_ = UNKNOWN; }
+    }
+
+    void forget_vertex_array(GLuint vertex_array)
+    {
+        if (vertex_array_ == vertex_array)
+        {
+            vertex_array_ = UNKNOWN;
+            element_array_buffer_ = UNKNOWN;
+        }
+    }
+
+    void forget_buffer(GLuint buffer)
+    {
+        for (GLuint* cached: {&array_buffer_, &element_array_buffer_, &uniform_buffer_}) {
+            if (*cached == buffer) { *cached = UNKNOWN; }
+        }
+    }
+
+    // Statistics of the frame being recorded and of the last complete frame
+    const GLStateStatistics& frame_statistics() const { return frame_; }
+    const GLStateStatistics& last_frame_statistics() const { return last_frame_; }
+
+private:
+    static constexpr GLuint UNKNOWN = 0xFFFFFFFF;
+
+    GLState()
+    {
+        initializeOpenGLFunctions();   // Initialise current context  (required)
+        invalidate();
+    }
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    void issued() { frame_.issued++; }
+    void elided() { frame_.elided++; }
+
+    // Updates the cached value, returns true if the GL call has to be made
+    bool changed(GLuint& cached, GLuint value)
+    {
+        if (cached == value)
+        {
+            elided();
+            return false;
+        }
+        cached = value;
+        issued();
+        return true;
+    }
+
+    GLuint* buffer_slot(GLenum target)
+    {
+        switch (target) {
+            case GL_ARRAY_BUFFER: { return &array_buffer_; }
+            case GL_ELEMENT_ARRAY_BUFFER: { return &element_array_buffer_; }
+            case GL_UNIFORM_BUFFER: { return &uniform_buffer_; }
+            default: { return nullptr; }
+        }
+    }
+
+    static int texture_target_index(GLenum target)
+    {
+        switch (target) {
+            case GL_TEXTURE_2D: { return 0; }
+            case GL_TEXTURE_CUBE_MAP: { return 1; }
+            default: { return -1; }
+        }
+    }
+
+    static int capability_index(GLenum capability)
+    {
+        switch (capability) {
+            case GL_BLEND: { return 0; }
+            case GL_CULL_FACE: { return 1; }
+            case GL_DEPTH_TEST: { return 2; }
+            case GL_STENCIL_TEST: { return 3; }
+            case GL_MULTISAMPLE: { return 4; }
+            case GL_POLYGON_OFFSET_FILL: { return 5; }
+            default: { return -1; }
+        }
+    }
+
+    GLuint program_ = UNKNOWN;
+    GLuint vertex_array_ = UNKNOWN;
+    GLuint array_buffer_ = UNKNOWN;
+    GLuint element_array_buffer_ = UNKNOWN;
+    GLuint uniform_buffer_ = UNKNOWN;
+    GLuint active_texture_ = UNKNOWN;
+    std::array<std::array<GLuint, 2>, GL_STATE_TEXTURE_UNITS> textures_;
+    std::array<int, 6> capabilities_;  // -1 unknown, 0 disabled, 1 enabled
+    GLuint blend_src_ = UNKNOWN;
+    GLuint blend_dst_ = UNKNOWN;
+    GLuint depth_func_ = UNKNOWN;
+    GLuint polygon_mode_ = UNKNOWN;
+    bool polygon_offset_known_ = false;
+    float polygon_offset_factor_ = 0;
+    float polygon_offset_units_ = 0;
+
+    GLStateStatistics frame_;
+    GLStateStatistics last_frame_;
+};
+
+// Shorthand used by the layer classes
+GLState& gl_state()
+{
+    return GLState::instance();
+}
+
+#endif
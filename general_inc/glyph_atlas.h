@@ -0,0 +1,276 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bookkeeping of the glyphs rasterised on demand (anything outside ASCII): UTF-8 decoding, the
+// code point -> glyph lookup table and the pages of the atlas they are packed in, evicted whole
+// and least recently used first when the atlas is full. No OpenGL needed.
+
+const char32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+// Code points of a UTF-8 string, invalid or truncated sequences (overlong forms, surrogates,
+// beyond U+10FFFF) become one REPLACEMENT_CHARACTER per byte
+std::u32string utf8_to_utf32(const std::string& text)
+{
+    std::u32string code_points;
+    code_points.reserve(text.size());
+    const std::size_t size = text.size();
+    std::size_t i = 0;
+    while (i < size)
+    {
+        const unsigned char lead = static_cast<unsigned char>(text[i]);
+        if (lead < 0x80) {
+            code_points.push_back(lead);
+            i++;
+            continue;
+        }
+        int length = 0;
+        char32_t code = 0, minimum = 0;
+        if ((lead & 0xE0) == 0xC0) { length = 2; code = lead & 0x1F; minimum = 0x80; }
+        else if ((lead & 0xF0) == 0xE0) { length = 3; code = lead & 0x0F; minimum = 0x800; }
+        else if ((lead & 0xF8) == 0xF0) { length = 4; code = lead & 0x07; minimum = 0x10000; }
+
+        bool valid = length > 0 && i + length <= size;
+        for (int k = 1; valid && k < length; k++) {
+            const unsigned char continuation = static_cast<unsigned char>(text[i + k]);
+            valid = (continuation & 0xC0) == 0x80;
+            code = (code << 6) | (continuation & 0x3F);
+        }
+        valid = valid && code >= minimum && code <= 0x10FFFF && (code < 0xD800 || code > 0xDFFF);
+        code_points.push_back(valid ? code : REPLACEMENT_CHARACTER);
+        i += valid ? length : 1;
+    }
+    return code_points;
+}
+
+/// Open addressed code point -> value table (linear probing, backward shift deletion so erasing
+// leaves no tombstones). One flat array, a lookup touches one or two cache lines.
+class GlyphTable
+{
+public:
+    GlyphTable()
+    {
+        rehash(64);
+    }
+
+    bool find(char32_t code, std::uint32_t& value) const
+    {
+        for (std::size_t i = home(code);; i = (i + 1) & mask_) {
+            const Entry& entry = entries_[i];
+            if (entry.code == code) {
+                value = entry.value;
+                return true;
+            }
+            if (entry.code == EMPTY) { return false; }
+        }
+    }
+
+    // Replaces the value of a code already present. Grows at 3/4 load.
+    void insert(char32_t code, std::uint32_t value)
+    {
+        if (4*(size_ + 1) > 3*entries_.size()) { rehash(2*entries_.size()); }
+        std::size_t i = home(code);
+        while (entries_[i].code != EMPTY && entries_[i].code != code) { i = (i + 1) & mask_; }
+        if (entries_[i].code == EMPTY) { size_++; }
+        entries_[i] = {code, value};
+    }
+
+    bool erase(char32_t code, std::uint32_t& value)
+    {
+        std::size_t i = home(code);
+        while (entries_[i].code != code) {
+            if (entries_[i].code == EMPTY) { return false; }
+            i = (i + 1) & mask_;
+        }
+        value = entries_[i].value;
+        size_--;
+
+        // pull back the entries of the run that would no longer be reachable past the hole
+        for (std::size_t j = (i + 1) & mask_; entries_[j].code != EMPTY; j = (j + 1) & mask_) {
+            std::size_t k = home(entries_[j].code);
+            bool reachable = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (reachable) { continue; }
+            entries_[i] = entries_[j];
+            i = j;
+        }
+        entries_[i].code = EMPTY;
+        return true;
+    }
+
+    std::size_t size() const { return size_; }
+
+private:
+    static constexpr char32_t EMPTY = 0xFFFFFFFFu;  // not a code point
+
+    struct Entry {
+        char32_t code;
+        std::uint32_t value;
+    };
+
+    // Fibonacci hashing, code points of one script are consecutive
+    std::size_t home(char32_t code) const
+    {
+        return (static_cast<std::uint32_t>(code)*2654435769u >> shift_) & mask_;
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        std::vector<Entry> old;
+        old.swap(entries_);
+        entries_.assign(capacity, Entry{EMPTY, 0});
+        mask_ = capacity - 1;
+        shift_ = 32;
+        for (std::size_t c = capacity; c > 1; c >>= 1) { shift_--; }
+        size_ = 0;
+        for (Entry const& entry: old) {
+            if (entry.code != EMPTY) { insert(entry.code, entry.value); }
+        }
+    }
+
+    std::vector<Entry> entries_;
+    std::size_t size_ = 0;
+    std::size_t mask_ = 0;
+    unsigned int shift_ = 32;
+};
+
+/// Lookups of the glyphs rasterised on demand, for tuning the number of atlas pages
+struct GlyphCacheStatistics {
+    std::size_t hits = 0;       // found in the atlas
+    std::size_t misses = 0;     // rasterised
+    std::size_t evictions = 0;  // pages emptied to make room
+    std::size_t overflows = 0;  // not drawn, every page was in use this frame
+    std::size_t resident = 0;   // glyphs in the atlas
+
+    double hit_rate() const
+    {
+        return hits + misses > 0 ? double(hits)/double(hits + misses) : 1.0;
+    }
+
+    GlyphCacheStatistics& operator+=(const GlyphCacheStatistics& other)
+    {
+        hits += other.hits;
+        misses += other.misses;
+        evictions += other.evictions;
+        overflows += other.overflows;
+        resident += other.resident;
+        return *this;
+    }
+};
+
+/// Where a glyph went: its page (-1 if there was no room) and top left corner in the page area,
+// plus the code points that were dropped if a page had to be emptied for it
+struct GlyphAllocation {
+    int page = -1;
+    glm::ivec2 position = glm::ivec2(0);
+    bool evicted = false;
+    std::vector<char32_t> evicted_codes;
+};
+
+/// Horizontal bands of the atlas, each filled in rows (shelves) like the baked ASCII set. A page
+// is only ever emptied whole, so there is no fragmentation. Pages used during the current frame
+// are never evicted: the quads drawn this frame still point at them.
+class GlyphPages
+{
+public:
+    GlyphPages(int page_count, int width, int height, int padding)
+        : pages_(page_count), width_(width), height_(height), padding_(padding)
+    {
+        for (Page& page: pages_) { clear(page); }
+    }
+
+    // Room for a width x rows glyph, in a page with space left or else the least recently used one
+    GlyphAllocation allocate(int width, int rows, std::uint64_t frame)
+    {
+        GlyphAllocation allocation;
+        if (width + 2*padding_ > width_ || rows + 2*padding_ > height_) { return allocation; }
+
+        for (std::size_t p = 0; p < pages_.size(); p++) {
+            if (place(pages_[p], width, rows, allocation.position)) {
+                allocation.page = static_cast<int>(p);
+                break;
+            }
+        }
+        if (allocation.page < 0)
+        {
+            int oldest = -1;
+            for (std::size_t p = 0; p < pages_.size(); p++) {
+                if (pages_[p].last_used < frame && (oldest < 0 || pages_[p].last_used < pages_[oldest].last_used)) {
+                    oldest = static_cast<int>(p);
+                }
+            }
+            if (oldest < 0) { return allocation; }
+            allocation.evicted = true;
+            allocation.evicted_codes.swap(pages_[oldest].codes);
+            clear(pages_[oldest]);
+            place(pages_[oldest], width, rows, allocation.position);
+            allocation.page = oldest;
+        }
+        touch(allocation.page, frame);
+        return allocation;
+    }
+
+    void add(int page, char32_t code)
+    {
+        pages_[page].codes.push_back(code);
+    }
+
+    void touch(int page, std::uint64_t frame)
+    {
+        pages_[page].last_used = frame;
+    }
+
+    // Every page with its bit set in page_mask (bit p for page p)
+    void touch_mask(std::uint32_t page_mask, std::uint64_t frame)
+    {
+        for (std::size_t p = 0; page_mask != 0 && p < pages_.size(); p++, page_mask >>= 1) {
+            if (page_mask & 1u) { pages_[p].last_used = frame; }
+        }
+    }
+
+    std::size_t count() const { return pages_.size(); }
+
+private:
+    struct Page {
+        int x, y, shelf_height;
+        std::uint64_t last_used;
+        std::vector<char32_t> codes;  // the glyphs to forget when the page is emptied
+    };
+
+    void clear(Page& page)
+    {
+        page.x = padding_;
+        page.y = padding_;
+        page.shelf_height = 0;
+        page.last_used = 0;
+        page.codes.clear();
+    }
+
+    bool place(Page& page, int width, int rows, glm::ivec2& position)
+    {
+        int x = page.x, y = page.y, shelf_height = page.shelf_height;
+        if (x + width + padding_ > width_)  // next shelf
+        {
+            x = padding_;
+            y += shelf_height + padding_;
+            shelf_height = 0;
+        }
+        if (y + rows + padding_ > height_) { return false; }
+        position = glm::ivec2(x, y);
+        page.x = x + width + padding_;
+        page.y = y;
+        page.shelf_height = std::max(shelf_height, rows);
+        return true;
+    }
+
+    std::vector<Page> pages_;
+    int width_, height_, padding_;
+};
+
+#endif
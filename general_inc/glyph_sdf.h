@@ -0,0 +1,126 @@
+#ifndef GLYPH_SDF_H
+#define GLYPH_SDF_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Signed distance field glyphs: every atlas pixel stores its distance to the glyph's outline
+// instead of its coverage, so bilinear filtering reconstructs a sharp edge at any scale and the
+// text shader can draw outlines and halos from the same texture. The glyph is rasterised several
+// times larger than the atlas and the exact Euclidean distances are measured on that bitmap.
+// No OpenGL needed.
+
+/// A glyph as stored in the atlas: one byte per pixel, rows top to bottom
+struct GlyphBitmap {
+    int width = 0;
+    int rows = 0;
+    glm::ivec2 bearing = glm::ivec2(0);  // from the pen position to the left/top of the bitmap [px]
+    std::vector<unsigned char> pixels;
+};
+
+const float SDF_FAR = 1e20f;
+
+// Squared distance transform of a sampled function along one row or column (Felzenszwalb and
+// Huttenlocher, "Distance Transforms of Sampled Functions"). v and z are scratch of n and n + 1.
+void distance_transform_1d(const float* f, float* d, int n, int* v, float* z)
+{
+    int k = 0;
+    v[0] = 0;
+    z[0] = -SDF_FAR;
+    z[1] = SDF_FAR;
+    for (int q = 1; q < n; q++)
+    {
+        float s = ((f[q] + float(q)*q) - (f[v[k]] + float(v[k])*v[k]))/(2.0f*q - 2.0f*v[k]);
+        while (s <= z[k])
+        {
+            k--;
+            s = ((f[q] + float(q)*q) - (f[v[k]] + float(v[k])*v[k]))/(2.0f*q - 2.0f*v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = SDF_FAR;
+    }
+    k = 0;
+    for (int q = 0; q < n; q++)
+    {
+        while (z[k + 1] < q) { k++; }
+        d[q] = float(q - v[k])*(q - v[k]) + f[v[k]];
+    }
+}
+
+// Squared distance of every pixel to the nearest pixel where feature is true
+std::vector<float> distance_transform(const std::vector<bool>& feature, int width, int height)
+{
+    std::vector<float> grid(feature.size());
+    for (std::size_t i = 0; i < feature.size(); i++) { grid[i] = feature[i] ? 0.0f : SDF_FAR; }
+
+    const int n = std::max(width, height);
+    std::vector<float> f(n), d(n), z(n + 1);
+    std::vector<int> v(n);
+    for (int x = 0; x < width; x++)
+    {
+        for (int y = 0; y < height; y++) { f[y] = grid[y*width + x]; }
+        distance_transform_1d(f.data(), d.data(), height, v.data(), z.data());
+        for (int y = 0; y < height; y++) { grid[y*width + x] = d[y]; }
+    }
+    for (int y = 0; y < height; y++)
+    {
+        distance_transform_1d(&grid[y*width], d.data(), width, v.data(), z.data());
+        std::copy(d.begin(), d.begin() + width, grid.begin() + y*width);
+    }
+    return grid;
+}
+
+// Distance field of a glyph from its coverage bitmap rasterised supersample times larger than
+// the atlas (left/top are FreeType's bitmap_left/bitmap_top at that size). The field has spread
+// atlas pixels of margin around the outline, 0.5 (128) on the outline and more inside.
+GlyphBitmap make_sdf_glyph(const unsigned char* coverage, int width, int rows, int pitch, int left, int top,
+                           int supersample, int spread)
+{
+    GlyphBitmap glyph;
+    if (width <= 0 || rows <= 0) { return glyph; }  // blank glyph (space)
+
+    auto floor_div = [](int a, int b) { return a >= 0 ? a/b : -((-a + b - 1)/b); };
+    auto ceil_div = [&floor_div](int a, int b) { return -floor_div(-a, b); };
+
+    // atlas pixels covered by the glyph and its margin, y up from the baseline
+    const int left_px = floor_div(left, supersample) - spread;
+    const int right_px = ceil_div(left + width, supersample) + spread;
+    const int top_px = ceil_div(top, supersample) + spread;
+    const int bottom_px = floor_div(top - rows, supersample) - spread;
+    glyph.width = right_px - left_px;
+    glyph.rows = top_px - bottom_px;
+    glyph.bearing = glm::ivec2(left_px, top_px);
+
+    // the same area at the rasterised size, the bitmap placed inside
+    const int grid_width = glyph.width*supersample, grid_height = glyph.rows*supersample;
+    const int offset_x = left - left_px*supersample, offset_y = top_px*supersample - top;
+    std::vector<bool> inside(std::size_t(grid_width)*grid_height, false);
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < width; x++) {
+            inside[std::size_t(y + offset_y)*grid_width + x + offset_x] = coverage[y*pitch + x] >= 128;
+        }
+    }
+    std::vector<bool> outside(inside.size());
+    for (std::size_t i = 0; i < inside.size(); i++) { outside[i] = !inside[i]; }
+    std::vector<float> to_inside = distance_transform(inside, grid_width, grid_height);
+    std::vector<float> to_outside = distance_transform(outside, grid_width, grid_height);
+
+    // sample the centre of every atlas pixel, the outline is half a pixel from the pixels on either side
+    glyph.pixels.resize(std::size_t(glyph.width)*glyph.rows);
+    for (int y = 0; y < glyph.rows; y++) {
+        for (int x = 0; x < glyph.width; x++) {
+            std::size_t sample = std::size_t(y*supersample + supersample/2)*grid_width + x*supersample + supersample/2;
+            float distance = inside[sample] ? -(std::sqrt(to_outside[sample]) - 0.5f) : std::sqrt(to_inside[sample]) - 0.5f;
+            float value = 0.5f - distance/(2.0f*spread*supersample);
+            glyph.pixels[std::size_t(y)*glyph.width + x] = static_cast<unsigned char>(glm::clamp(value, 0.0f, 1.0f)*255.0f + 0.5f);
+        }
+    }
+    return glyph;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+/// GPU time spent drawing one layer during a frame
+struct GpuTiming {
+    std::string label;
+    double milliseconds;
+};
+
+/// Per-layer GL_TIME_ELAPSED queries, double buffered.
+// Queries issued during frame N are read back at the start of frame N+2, when the set is
+// reused, so reading them never waits for the GPU. A label may be timed several times per
+// frame (eg. one query per model), its queries are summed. Results that are still not
+// available when the set is reused are dropped rather than waited for.
+// GL_TIME_ELAPSED queries can't be nested, only one label may be active at a time.
+class GpuTimers: protected QOpenGLFunctions_3_3_Core
+{
+public:
+    GpuTimers()
+    {
+        initializeOpenGLFunctions();   // Initialise current context  (required)
+    }
+
+    ~GpuTimers()
+    {
+        for (auto& entry: timers_) {
+            for (auto& slot: entry.second) {
+                if (!slot.queries.empty()) { glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data()); }
+            }
+        }
+    }
+
+    GpuTimers(const GpuTimers&) = delete;
+    GpuTimers& operator=(const GpuTimers&) = delete;
+
+    // Collects the results of the set about to be reused
+    void begin_frame()
+    {
+        current_ = frame_ % 2;
+        frame_++;
+
+        timings_.clear();
+        for (auto& entry: timers_) {
+            TimerSlot& slot = entry.second[current_];
+            if (slot.used == 0) { continue; }  // layer wasn't drawn that frame
+
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available == GL_TRUE)
+            {
+                // queries complete in order so all earlier ones are available too
+                GLuint64 total_ns = 0;
+                for (std::size_t i = 0; i < slot.used; i++) {
+                    GLuint64 elapsed_ns = 0;
+                    glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &elapsed_ns);
+                    total_ns += elapsed_ns;
+                }
+                timings_.push_back({entry.first, total_ns/1.0e6});
+            }
+            else { dropped_++; }
+            slot.used = 0;
+        }
+    }
+
+    void begin(const char* label)
+    {
+        auto entry = timers_.find(label);  // heterogeneous lookup, only allocates for new labels
+        if (entry == timers_.end()) { entry = timers_.emplace(label, std::array<TimerSlot, 2>()).first; }
+        TimerSlot& slot = entry->second[current_];
+        if (slot.used == slot.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.used++]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    // Latest complete per-layer timings (sorted by label)
+    const std::vector<GpuTiming>& timings() const
+    {
+        return timings_;
+    }
+
+    // Number of layer results dropped because the GPU was more than a frame behind
+    unsigned long dropped() const
+    {
+        return dropped_;
+    }
+
+private:
+    struct TimerSlot {
+        std::vector<GLuint> queries;
+        std::size_t used = 0;
+    };
+
+    std::map<std::string, std::array<TimerSlot, 2>, std::less<>> timers_;
+    std::vector<GpuTiming> timings_;
+    unsigned long frame_ = 0;
+    unsigned int current_ = 0;
+    unsigned long dropped_ = 0;
+};
+
+#endif
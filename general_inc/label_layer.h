@@ -0,0 +1,470 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/font_cache.h>
+#include <general_inc/text.h>
+#include <general_inc/profiler.h>
+
+
+/// One glyph of a label, drawn as an instance of a 4 vertex quad (see label.vs)
+struct GlyphInstance {
+    glm::vec3 Anchor;       // position of the label
+    glm::vec4 Quad;         // left, bottom, width, height from the anchor (0 width: unused instance)
+    std::uint16_t UV[4];    // top left and bottom right in the atlas, normalised
+    std::uint8_t Color[4];  // RGBA, normalised
+};
+
+using LabelId = std::uint32_t;
+
+const std::uint32_t LABEL_MIN_CAPACITY = 4;          // glyphs, label ranges are powers of two from there
+const std::size_t LABEL_UPLOAD_MERGE_GAP = 64;       // dirty ranges closer than this many glyphs are uploaded together
+const std::size_t LABEL_COMPACT_MIN_HOLES = 1024;    // glyphs in freed ranges before compacting is worth it
+
+/// Many short texts sharing one font, scale and billboard mode, drawn in one instanced call.
+// Every label owns a range of glyph instances in one buffer, sized to the next power of two, so
+// changing a label only rewrites (and uploads) its own range. Ranges of removed labels are cleared
+// and reused by labels of the same size, and the buffer is compacted once half of it is holes.
+// The glyphs come from the shared FontCache, like Text3D.
+class LabelLayer: protected QOpenGLFunctions_3_3_Core
+{
+public:
+
+    // scale is per pixel of a GLYPH_PIXEL_SIZE glyph, in screen units for fixed size labels
+    // (as Text3D) and world units otherwise
+    LabelLayer(float scale, bool fixed_size = true, GlyphRendering rendering = GlyphRendering::SDF)
+    {
+        scale_ = scale;
+        fixed_size_ = fixed_size;
+
+        initializeOpenGLFunctions();   // Initialise current context  (required)
+
+        // Label shaders (shared between all label layers)
+        m_label_shader = get_shader(LABEL_VS, LABEL_FS);
+        m_font = &FontCache::instance().acquire(TEXT_FONT_PATH.string(), rendering);
+
+        setup();
+    }
+
+    void setup()
+    {
+        glGenVertexArrays(1, &vao_);
+        glGenBuffers(1, &vbo_);
+        gl_state().bind_vertex_array(vao_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
+
+        // One set of attributes per glyph instance, the quad corners come from gl_VertexID
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)offsetof(GlyphInstance, Anchor));
+        glVertexAttribDivisor(0, 1);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)offsetof(GlyphInstance, Quad));
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(GlyphInstance), (void*)offsetof(GlyphInstance, UV));
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GlyphInstance), (void*)offsetof(GlyphInstance, Color));
+        glVertexAttribDivisor(3, 1);
+    }
+
+    // text is UTF-8 and may have several lines. The id stays valid until remove().
+    LabelId add(const std::string& text, const glm::vec3& position, const glm::vec4& color = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))
+    {
+        LabelId id;
+        if (free_ids_.empty())
+        {
+            id = static_cast<LabelId>(labels_.size());
+            labels_.emplace_back();
+        }
+        else
+        {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        }
+        Label& label = labels_[id];
+        label = Label();
+        label.text = text;
+        label.position = position;
+        label.color = pack_color(color);
+        label.alive = true;
+        label_count_++;
+        anchor_box_.extend(position);
+        write_label(id);
+        return id;
+    }
+
+    void remove(LabelId id)
+    {
+        if (!alive(id)) { return; }
+        Label& label = labels_[id];
+        free_range(label);
+        label = Label();
+        free_ids_.push_back(id);
+        label_count_--;
+        if (free_glyphs_ > LABEL_COMPACT_MIN_HOLES && 2*free_glyphs_ > instances_.size()) { compact(); }
+    }
+
+    void set_text(LabelId id, const std::string& text)
+    {
+        if (!alive(id) || labels_[id].text == text) { return; }
+        labels_[id].text = text;
+        write_label(id);
+    }
+
+    // Only the anchors of the label's glyphs are rewritten
+    void set_position(LabelId id, const glm::vec3& position)
+    {
+        if (!alive(id)) { return; }
+        Label& label = labels_[id];
+        label.position = position;
+        anchor_box_.extend(position);
+        for (std::uint32_t i = label.first; i < label.first + label.count; i++) { instances_[i].Anchor = position; }
+        mark_dirty(label.first, label.count);
+    }
+
+    void set_color(LabelId id, const glm::vec4& color)
+    {
+        if (!alive(id)) { return; }
+        Label& label = labels_[id];
+        label.color = pack_color(color);
+        for (std::uint32_t i = label.first; i < label.first + label.count; i++) {
+            std::copy(label.color.begin(), label.color.end(), instances_[i].Color);
+        }
+        mark_dirty(label.first, label.count);
+    }
+
+    bool alive(LabelId id) const
+    {
+        return id < labels_.size() && labels_[id].alive;
+    }
+
+    std::size_t size() const
+    {
+        return label_count_;
+    }
+
+    // Outline and halo of every label, widths in atlas pixels as for Text3D. SDF only.
+    void set_outline(glm::vec4 color, float width)
+    {
+        outline_color_ = color;
+        outline_width_ = glm::clamp(width, 0.0f, m_font->spread);
+        halo_width_ = std::min(halo_width_, m_font->spread - outline_width_);
+    }
+
+    void set_halo(glm::vec4 color, float width)
+    {
+        halo_color_ = color;
+        halo_width_ = glm::clamp(width, 0.0f, m_font->spread - outline_width_);
+    }
+
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix)
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw();
+    }
+
+    // Draw every label using the camera matrices (and camera right/up vectors) of the shared CameraBlock uniform buffer
+    void draw()
+    {
+        // Every label is laid out again when the font emptied an atlas page, some of the glyphs may have been there
+        if (m_font->evictions() != built_evictions_) { relayout(); }
+        else if (!overflowed_.empty()) { retry_overflowed(); }
+        m_font->touch(glyph_pages_);
+        upload();
+        if (instances_.empty()) { return; }
+
+        // OpenGL state
+        // ------------
+        gl_state().enable(GL_CULL_FACE);
+        gl_state().enable(GL_BLEND);
+        gl_state().blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        m_label_shader->use();
+        m_label_shader->setBool("fixed_size", fixed_size_);
+
+        // Widths in distance units, the atlas goes from 0 to 1 over 2*spread pixels
+        const bool sdf = m_font->rendering == GlyphRendering::SDF;
+        m_label_shader->setBool("sdf", sdf);
+        if (sdf)
+        {
+            m_label_shader->setFloat("outline_width", outline_width_/(2.0f*m_font->spread));
+            m_label_shader->setVec4("outlineColor", outline_color_);
+            m_label_shader->setFloat("halo_width", halo_width_/(2.0f*m_font->spread));
+            m_label_shader->setVec4("haloColor", halo_color_);
+        }
+
+        // Every glyph of every label in one draw, unused instances are empty quads
+        gl_state().bind_texture(0, GL_TEXTURE_2D, m_font->atlas_texture);
+        gl_state().bind_vertex_array(vao_);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(instances_.size()));
+        gl_state().count_draw();
+    }
+
+    // Blended like Text3D, so the labels go with the transparent items
+    void submit(RenderQueue& queue)
+    {
+        if (label_count_ == 0) { return; }
+        Bounds layer_bounds = bounds();
+        if (!queue.visible(layer_bounds)) { return; }
+        queue.submit(RenderPass::TRANSPARENT, "labels", m_label_shader->ID, m_font->atlas_texture, layer_bounds.box.center(),
+                     [this]() { draw(); });
+    }
+
+    // Box and sphere around the anchors, padded by the largest label for labels of world size (fixed
+    // size labels may stick out a little). They only grow, until the buffer is compacted.
+    Bounds bounds() const
+    {
+        Bounds layer_bounds;
+        layer_bounds.box = anchor_box_;
+        if (layer_bounds.box.empty()) { return layer_bounds; }
+        layer_bounds.sphere.center = anchor_box_.center();
+        layer_bounds.sphere.radius = glm::length(anchor_box_.half_size());
+        if (!fixed_size_) { layer_bounds.pad(max_extent_); }
+        return layer_bounds;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(instances_) + heap_bytes(labels_) + heap_bytes(free_ids_) + heap_bytes(free_ranges_) + heap_bytes(overflowed_) +
+                          dirty_.capacity()*sizeof(std::pair<std::uint32_t, std::uint32_t>);
+        for (auto const& label: labels_) { usage.cpu_bytes += label.text.capacity(); }
+        usage.gpu_bytes = gpu_capacity_*sizeof(GlyphInstance);
+        return usage;
+    }
+
+private:
+    struct Label {
+        std::string text;
+        glm::vec3 position = glm::vec3(0.0f);
+        std::array<std::uint8_t, 4> color = {0, 0, 0, 255};
+        std::uint32_t first = 0;     // range of the glyph instances
+        std::uint32_t count = 0;
+        std::uint32_t capacity = 0;  // 0 or a power of two from LABEL_MIN_CAPACITY
+        bool alive = false;
+    };
+
+    static std::array<std::uint8_t, 4> pack_color(const glm::vec4& color)
+    {
+        glm::vec4 clamped = glm::clamp(color, 0.0f, 1.0f)*255.0f + 0.5f;
+        return {std::uint8_t(clamped.r), std::uint8_t(clamped.g), std::uint8_t(clamped.b), std::uint8_t(clamped.a)};
+    }
+
+    static std::uint16_t pack_uv(float uv)
+    {
+        return static_cast<std::uint16_t>(glm::clamp(uv, 0.0f, 1.0f)*65535.0f + 0.5f);
+    }
+
+    // log2 of the capacity, the index of the free list
+    static std::size_t size_class(std::uint32_t capacity)
+    {
+        std::size_t size = 0;
+        while ((LABEL_MIN_CAPACITY << size) < capacity) { size++; }
+        return size;
+    }
+
+    // Lays the label's glyphs out into its range, moving it to a larger one when it no longer fits
+    void write_label(LabelId id)
+    {
+        Label& label = labels_[id];
+        const std::size_t overflows = m_font->overflows();
+        glyphs_.clear();
+        layout_glyphs(*m_font, split_lines(label.text), glyph_scale(*m_font, scale_), &glyph_pages_,
+                      [&](const Character& ch, float x, float y, float w, float h) {
+            GlyphInstance glyph;
+            glyph.Anchor = label.position;
+            glyph.Quad = glm::vec4(x, y, w, h);
+            glyph.UV[0] = pack_uv(ch.UVMin.x);
+            glyph.UV[1] = pack_uv(ch.UVMin.y);
+            glyph.UV[2] = pack_uv(ch.UVMax.x);
+            glyph.UV[3] = pack_uv(ch.UVMax.y);
+            std::copy(label.color.begin(), label.color.end(), glyph.Color);
+            glyphs_.push_back(glyph);
+            max_extent_ = std::max({max_extent_, std::abs(x), std::abs(y), std::abs(x + w), std::abs(y + h)});
+        });
+
+        const std::uint32_t count = static_cast<std::uint32_t>(glyphs_.size());
+        if (count > label.capacity)
+        {
+            free_range(label);
+            allocate_range(label, count);
+        }
+        std::copy(glyphs_.begin(), glyphs_.end(), instances_.begin() + label.first);
+        for (std::uint32_t i = label.first + count; i < label.first + label.count; i++) { instances_[i] = GlyphInstance(); }
+        mark_dirty(label.first, std::max(count, label.count));
+        label.count = count;
+        if (m_font->overflows() != overflows) { overflowed_.push_back(id); }
+    }
+
+    void allocate_range(Label& label, std::uint32_t count)
+    {
+        std::uint32_t capacity = LABEL_MIN_CAPACITY;
+        while (capacity < count) { capacity *= 2; }
+        std::size_t size = size_class(capacity);
+        if (size < free_ranges_.size() && !free_ranges_[size].empty())
+        {
+            label.first = free_ranges_[size].back();
+            free_ranges_[size].pop_back();
+            free_glyphs_ -= capacity;
+        }
+        else
+        {
+            label.first = static_cast<std::uint32_t>(instances_.size());
+            instances_.resize(instances_.size() + capacity);
+        }
+        label.capacity = capacity;
+        label.count = 0;
+    }
+
+    // Clears the label's glyphs and keeps the range for a label of the same size
+    void free_range(Label& label)
+    {
+        if (label.capacity == 0) { return; }
+        for (std::uint32_t i = label.first; i < label.first + label.count; i++) { instances_[i] = GlyphInstance(); }
+        mark_dirty(label.first, label.count);
+        free_glyphs_ += label.capacity;
+        std::size_t size = size_class(label.capacity);
+        if (free_ranges_.size() <= size) { free_ranges_.resize(size + 1); }
+        free_ranges_[size].push_back(label.first);
+        label.capacity = 0;
+        label.count = 0;
+    }
+
+    // Packs the live labels' ranges together, dropping the holes, and recomputes the bounds
+    void compact()
+    {
+        PROFILE_SCOPE("LabelLayer::compact");
+        std::vector<GlyphInstance> compacted;
+        compacted.reserve(instances_.size() - free_glyphs_);
+        anchor_box_ = AABB();
+        for (Label& label: labels_)
+        {
+            if (!label.alive || label.capacity == 0) { continue; }
+            std::uint32_t first = static_cast<std::uint32_t>(compacted.size());
+            compacted.insert(compacted.end(), instances_.begin() + label.first, instances_.begin() + label.first + label.capacity);
+            label.first = first;
+            anchor_box_.extend(label.position);
+        }
+        instances_.swap(compacted);
+        for (auto& ranges: free_ranges_) { ranges.clear(); }
+        free_glyphs_ = 0;
+        upload_all_ = true;
+    }
+
+    // After an atlas eviction, the glyphs of every label may have moved
+    void relayout()
+    {
+        PROFILE_SCOPE("LabelLayer::relayout");
+        glyph_pages_ = 0;
+        max_extent_ = 0.0f;
+        overflowed_.clear();
+        for (LabelId id = 0; id < labels_.size(); id++) {
+            if (labels_[id].alive) { write_label(id); }
+        }
+        built_evictions_ = m_font->evictions();
+        upload_all_ = true;
+    }
+
+    // Labels with glyphs the atlas had no room for, the pages used last frame may be free now
+    void retry_overflowed()
+    {
+        std::vector<LabelId> ids;
+        ids.swap(overflowed_);
+        for (LabelId id: ids) {
+            if (alive(id)) { write_label(id); }
+        }
+    }
+
+    void mark_dirty(std::uint32_t first, std::uint32_t count)
+    {
+        if (count > 0 && !upload_all_) { dirty_.emplace_back(first, first + count); }
+    }
+
+    // Uploads the changed ranges (merged when close), or the whole buffer when it grew
+    void upload()
+    {
+        if (!upload_all_ && dirty_.empty()) { return; }
+        PROFILE_SCOPE("LabelLayer::upload");
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
+        if (instances_.size() > gpu_capacity_)
+        {
+            gpu_capacity_ = std::max(instances_.size(), gpu_capacity_ + gpu_capacity_/2);
+            glBufferData(GL_ARRAY_BUFFER, gpu_capacity_*sizeof(GlyphInstance), nullptr, GL_DYNAMIC_DRAW);
+            upload_all_ = true;
+        }
+        if (upload_all_)
+        {
+            if (!instances_.empty())
+                glBufferSubData(GL_ARRAY_BUFFER, 0, instances_.size()*sizeof(GlyphInstance), instances_.data());
+        }
+        else
+        {
+            std::sort(dirty_.begin(), dirty_.end());
+            std::uint32_t begin = dirty_[0].first, end = dirty_[0].second;
+            for (std::size_t i = 1; i <= dirty_.size(); i++)
+            {
+                if (i < dirty_.size() && dirty_[i].first <= end + LABEL_UPLOAD_MERGE_GAP)
+                {
+                    end = std::max(end, dirty_[i].second);
+                    continue;
+                }
+                end = std::min(end, static_cast<std::uint32_t>(instances_.size()));
+                if (end > begin)
+                    glBufferSubData(GL_ARRAY_BUFFER, begin*sizeof(GlyphInstance), (end - begin)*sizeof(GlyphInstance), &instances_[begin]);
+                if (i < dirty_.size())
+                {
+                    begin = dirty_[i].first;
+                    end = dirty_[i].second;
+                }
+            }
+        }
+        dirty_.clear();
+        upload_all_ = false;
+    }
+
+    Font* m_font = nullptr;                  // shared glyph atlas, owned by the FontCache
+    std::shared_ptr<Shader> m_label_shader;
+    unsigned int vao_, vbo_;
+    float scale_ = 1.0f;
+    bool fixed_size_ = true;
+
+    std::vector<Label> labels_;              // indexed by LabelId
+    std::vector<LabelId> free_ids_;
+    std::size_t label_count_ = 0;
+    std::vector<GlyphInstance> instances_;   // what the buffer holds, ranges of the labels and holes
+    std::vector<std::vector<std::uint32_t>> free_ranges_;  // first glyph of free ranges, by size_class()
+    std::size_t free_glyphs_ = 0;            // instances in free_ranges_, compacted once they are half the buffer
+    std::vector<GlyphInstance> glyphs_;      // scratch of write_label()
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> dirty_;  // [first, end) of the instances to upload
+    bool upload_all_ = false;
+    std::size_t gpu_capacity_ = 0;           // [instances]
+
+    std::uint32_t glyph_pages_ = 0;          // atlas pages of the glyphs, touched every draw
+    std::size_t built_evictions_ = 0;        // m_font->evictions() when the glyphs were laid out
+    std::vector<LabelId> overflowed_;        // labels laid out with glyphs missing, see retry_overflowed()
+    AABB anchor_box_;
+    float max_extent_ = 0.0f;                // furthest glyph corner from its anchor
+
+    glm::vec4 outline_color_ = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    float outline_width_ = 0.0f;             // [atlas px]
+    glm::vec4 halo_color_ = glm::vec4(1.0f, 1.0f, 1.0f, 0.5f);
+    float halo_width_ = 0.0f;                // [atlas px]
+};
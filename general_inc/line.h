@@ -4,13 +4,16 @@
 #include <glm/glm.hpp>
 #include <Eigen/Core>
 
+#include <utility>
 #include <vector>
 #include <stdexcept>
 
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
 #include <general_inc/utilities.h>
 
 class Line: protected QOpenGLFunctions_3_3_Core
@@ -19,30 +22,30 @@ public:
     
     Line() = delete; // need to at least give some coordinates
 
-    Line(std::vector<std::vector<Eigen::Vector3f>> lines, float linewidth = DEFAULT_LINE_WIDTH, Color linecolor = Color::GREEN)
+    // Pass the lines with std::move when the caller no longer needs them. Lines have no picking,
+    // anything but KEEP_ALL frees the coordinates and vertices once they are uploaded.
+    Line(std::vector<std::vector<Eigen::Vector3f>> lines, float linewidth = DEFAULT_LINE_WIDTH, Color linecolor = Color::GREEN,
+         Retention retention = Retention::DROP_AFTER_UPLOAD)
     {
         linewidth_ = linewidth;
         linecolor_ = linecolor;
-        lines_ = lines;
-        lines_count_ = lines.size();
+        lines_ = std::move(lines);
+        lines_count_ = lines_.size();
         
-        // Line shader
-        const char* vertex_line_path = LINE_VS.string().c_str();
-        const char* fragment_line_path = LINE_FS.string().c_str();
-        const char* geometry_line_path = LINE_GS.string().c_str();
-        m_line_shader = new Shader(vertex_line_path, fragment_line_path, geometry_line_path);
+        // Line shader (shared between all lines)
+        m_line_shader = get_shader(LINE_VS, LINE_FS, LINE_GS);
 
         SimpleVertex vertex;
 
-        unsigned int element_start_index = 0;
-        unsigned int line_size = 0;
+        GLint element_start_index = 0;
+        elements_start_indexes_.reserve(lines_count_);
+        element_vertex_count_.reserve(lines_count_);
 
         for(std::size_t i = 0; i < lines_count_; ++i) {
 
-            const std::vector<Eigen::Vector3f>& line = lines[i];
-            line_size = line.size();
-            element_vertex_count_[i] = (GLsizei)line_size;
-            elements_start_indexes_[i] = (GLuint)element_start_index;
+            const std::vector<Eigen::Vector3f>& line = lines_[i];
+            element_vertex_count_.push_back((GLsizei)line.size());
+            elements_start_indexes_.push_back(element_start_index);
 
             for (const Eigen::Vector3f& coordinate : line) {// access by const reference  
                 glm::vec3 vector; 
@@ -55,7 +58,7 @@ public:
                 vertices_.push_back(vertex);
             }
             
-            element_start_index += line_size;
+            element_start_index += (GLint)line.size();
 
         }
 
@@ -63,22 +66,27 @@ public:
  
         // Setup opengl states
         setup(); 
-    }
 
-    ~Line() {
-        delete m_line_shader;
+        vertex_count_ = vertices_.size();
+        if (retention != Retention::KEEP_ALL) {
+            release(lines_);
+            release(vertices_);
+        }
     }
 
     void setup()
     {
+        bounds_ = vertex_bounds(vertices_);
+        center_ = bounds_.box.center();
+
         // Create the buffers and array:
         glGenVertexArrays(1, &vao_);
         glGenBuffers(1, &vbo_);
 
-        glBindVertexArray(vao_);  
+        gl_state().bind_vertex_array(vao_);  
 
         // load data into buffers
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(SimpleVertex), &vertices_[0], GL_STATIC_DRAW);  
 
         // set the vertex attribute pointers:
@@ -89,15 +97,21 @@ public:
         // glBindVertexArray(0);  // Unbind vao
     }
 
-    void draw(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f))
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix)
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw();
+    }
+
+    // Draw using the camera matrices of the shared CameraBlock uniform buffer
+    void draw()
     {
         m_line_shader->use();  // Bind shader
 
         // Set the uniforms:
         glm::vec4 ourcolor = get_color(linecolor_);  // get the color
         m_line_shader->setVec4("ourColor", ourcolor); // Set uniform
-        m_line_shader->setMat4("view", view_matrix);
-        m_line_shader->setMat4("projection", projection_matrix);
         
         // Set linewidth uniform
          
@@ -106,24 +120,51 @@ public:
         m_line_shader->setFloat("thickness", linewidth_*LINEWIDTH_SCALING_FACTOR);
 
         // Draw lines
-        glEnable(GL_MULTISAMPLE);  
-        glBindVertexArray(vao_);
-        glMultiDrawArrays(GL_LINE_STRIP, elements_start_indexes_, element_vertex_count_, lines_count_); //
+        gl_state().enable(GL_MULTISAMPLE);
+        gl_state().disable(GL_CULL_FACE);
+        gl_state().disable(GL_BLEND);
+        gl_state().bind_vertex_array(vao_);
+        glMultiDrawArrays(GL_LINE_STRIP, elements_start_indexes_.data(), element_vertex_count_.data(), lines_count_); //
+        gl_state().count_draw();
         // glDrawArrays(GL_LINE_STRIP, 0, vertices_.size()); 
-        glBindVertexArray(0);  // Unbind vao
+    }
+
+    // Queue the draw, sorted with the other opaque layers by program and distance to the camera
+    void submit(RenderQueue& queue)
+    {
+        if (!queue.visible(bounds_))
+            return;
+        queue.submit(RenderPass::OPAQUE, "lines", m_line_shader->ID, 0, center_, [this]() { draw(); });
+    }
+
+    // Model space box and sphere, tested against the view frustum before submitting
+    const Bounds& bounds() const
+    {
+        return bounds_;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(vertices_) + heap_bytes(lines_) + heap_bytes(elements_start_indexes_) + heap_bytes(element_vertex_count_);
+        usage.gpu_bytes = vertex_count_*sizeof(SimpleVertex);
+        return usage;
     }
 
 private:
     Color linecolor_ = Color::GREEN;
     float linewidth_ = DEFAULT_LINE_WIDTH;
-    std::vector<SimpleVertex> vertices_;
+    std::vector<SimpleVertex> vertices_;  // empty after setup() unless Retention::KEEP_ALL
+    std::size_t vertex_count_ = 0;
+    Bounds bounds_;
+    glm::vec3 center_ = glm::vec3(0.0f);  // sort position in the render queue
     unsigned int vao_, vbo_;
-    Shader* m_line_shader;
+    std::shared_ptr<Shader> m_line_shader;
 
-    std::vector<std::vector<Eigen::Vector3f>> lines_;
+    std::vector<std::vector<Eigen::Vector3f>> lines_;  // empty after setup() unless Retention::KEEP_ALL
     GLuint lines_count_ = 1;
-    GLsizei elements_start_indexes_[MAX_FEATURES];
-    GLsizei element_vertex_count_[MAX_FEATURES];
+    std::vector<GLint> elements_start_indexes_;
+    std::vector<GLsizei> element_vertex_count_;
 };
 
 #endif
\ No newline at end of file
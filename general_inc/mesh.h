@@ -7,14 +7,20 @@
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
+#include <general_inc/bounds.h>
 #include <general_inc/shader.h>
 
+#include <cstdint>
+#include <iostream>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
 
+const float HALF_TEXCOORDS_MAX = 4.0f;  // texture coordinates beyond +-4 stay 32 bit floats (half precision would be coarser than ~1/256)
+
 struct Vertex {
     // position
     glm::vec3 Position;
@@ -32,128 +38,333 @@ struct Vertex {
 	float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+/// Attributes uploaded for a mesh, chosen per mesh by the importer.
+// GPU layout (interleaved, in this order):
+//   position  (location 0) 3 x GL_FLOAT                                12 bytes
+//   normal    (location 1) GL_INT_2_10_10_10_REV normalised             4 bytes
+//   texcoords (location 2) 2 x GL_HALF_FLOAT (2 x GL_FLOAT if !half)    4 (8) bytes
+//   tangent   (location 3) GL_INT_2_10_10_10_REV normalised, w = sign   4 bytes
+//   bone ids  (location 5) 4 x GL_UNSIGNED_SHORT                        8 bytes
+//   weights   (location 6) 4 x GL_UNSIGNED_BYTE normalised              4 bytes
+// The bitangent (location 4) isn't stored, it is cross(normal, tangent.xyz) * tangent.w.
+// Missing attributes are left disabled so the shader reads the generic default (0, 0, 0, 1).
+// Instanced draws add the model matrix (locations 7 to 10, one column each) from a separate
+// buffer, see MeshArena::set_instance_buffer.
+struct VertexFormat {
+    bool normals = false;
+    bool texcoords = false;
+    bool half_texcoords = true;
+    bool tangents = false;
+    bool bones = false;
+
+    GLsizei normal_offset() const { return 3*sizeof(float); }
+    GLsizei texcoords_offset() const { return normal_offset() + (normals ? sizeof(std::uint32_t) : 0); }
+    GLsizei tangent_offset() const { return texcoords_offset() + (texcoords ? texcoords_size() : 0); }
+    GLsizei bones_offset() const { return tangent_offset() + (tangents ? sizeof(std::uint32_t) : 0); }
+    GLsizei weights_offset() const { return bones_offset() + MAX_BONE_INFLUENCE*sizeof(std::uint16_t); }
+    GLsizei stride() const { return bones_offset() + (bones ? MAX_BONE_INFLUENCE*(sizeof(std::uint16_t) + 1) : 0); }
+
+    bool operator==(const VertexFormat& other) const
+    {
+        return normals == other.normals && texcoords == other.texcoords && tangents == other.tangents && bones == other.bones &&
+               (!texcoords || half_texcoords == other.half_texcoords);
+    }
+
+private:
+    GLsizei texcoords_size() const { return half_texcoords ? 2*sizeof(std::uint16_t) : 2*sizeof(float); }
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
-class Mesh 
+// Sampler naming convention of the model shaders: texture_<type>N, N from 1 to MATERIAL_TEXTURES_PER_TYPE
+const unsigned int MATERIAL_TEXTURE_TYPE_COUNT = 4;
+const char* const MATERIAL_TEXTURE_TYPES[MATERIAL_TEXTURE_TYPE_COUNT] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+const unsigned int MATERIAL_TEXTURES_PER_TYPE = 4;  // 4 types x 4 = the 16 texture units GL 3.3 guarantees
+
+/// One texture of a material and where the shader reads it
+struct MaterialBinding {
+    GLuint texture;
+    GLuint unit;              // fixed by the sampler name, see Material
+    string sampler;           // eg. texture_diffuse1
+    Uniform location;         // of sampler in the program the material was last bound with
+};
+
+/// Textures bound together for a draw, built once at import and shared by all the meshes
+// of a model that use them.
+// Units are assigned by sampler name (texture_diffuse1 is always unit 0, texture_specular1 unit 4, ...)
+// so every material agrees on the sampler uniform values of a program: they are only set the
+// first time a material is bound with a program. Textures whose sampler isn't used by the
+// program (optimised out) are not bound at all. bind() doesn't allocate.
+class Material
 {
 public:
-    // mesh Data
-    vector<Vertex>       vertices;
-    vector<unsigned int> indices;
-    vector<Texture>      textures;
-    unsigned int VAO;
-
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    explicit Material(const vector<Texture>& textures)
+    {
+        unsigned int count[MATERIAL_TEXTURE_TYPE_COUNT] = {};
+        for (Texture const& texture: textures)
+        {
+            unsigned int type = 0;
+            while (type < MATERIAL_TEXTURE_TYPE_COUNT && texture.type != MATERIAL_TEXTURE_TYPES[type])
+                type++;
+            if (type == MATERIAL_TEXTURE_TYPE_COUNT || count[type] == MATERIAL_TEXTURES_PER_TYPE)
+            {
+                std::cout << "WARNING::MATERIAL::TEXTURE_IGNORED " << texture.type << " " << texture.path << std::endl;
+                continue;
+            }
+            bindings_.push_back({texture.id, type*MATERIAL_TEXTURES_PER_TYPE + count[type],
+                                 texture.type + std::to_string(count[type] + 1), Uniform()});
+            count[type]++;
+        }
+    }
+
+    bool operator==(const Material& other) const
+    {
+        if (bindings_.size() != other.bindings_.size())
+            return false;
+        for (size_t i = 0; i < bindings_.size(); i++)
+            if (bindings_[i].texture != other.bindings_[i].texture || bindings_[i].unit != other.bindings_[i].unit)
+                return false;
+        return true;
+    }
+
+    // binds the textures the program samples (shader must be in use)
+    void bind(Shader &shader)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        if (shader.ID != resolved_program_)
+            resolve(shader);
+        for (MaterialBinding const& binding: bindings_)
+        {
+            if (binding.location.location >= 0)
+                gl_state().bind_texture(binding.unit, GL_TEXTURE_2D, binding.texture);
+        }
+    }
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+    const vector<MaterialBinding>& bindings() const { return bindings_; }
+
+private:
+    // looks the samplers up in the program and points them at their units
+    void resolve(Shader &shader)
+    {
+        for (MaterialBinding& binding: bindings_)
+        {
+            binding.location = shader.uniform(binding.sampler.c_str());
+            if (binding.location.location >= 0)
+                shader.setInt(binding.location, (int)binding.unit);
+        }
+        resolved_program_ = shader.ID;
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
+    vector<MaterialBinding> bindings_;
+    GLuint resolved_program_ = 0;
+};
+
+const GLuint INSTANCE_MATRIX_LOCATION = 7;  // first of the 4 columns of the per instance model matrix
+
+const unsigned int MESH_LOD_MAX = 4;  // full detail and up to three simplified levels
+
+/// A level of detail of a mesh, a range of its indices (every level uses the same vertices)
+struct MeshLod {
+    unsigned int first_index = 0;  // from the mesh's first index
+    unsigned int index_count = 0;
+    float error = 0.0f;            // how far the level strays from the full detail surface [model units]
+};
+
+/// A sub-mesh of a model: a range of its arena's index buffer drawn with one material
+struct Mesh {
+    unsigned int arena = 0;         // in Model::arenas
+    unsigned int material = 0;      // in Model::materials
+    unsigned int vertex_count = 0;
+    unsigned int first_index = 0;   // into the arena's index buffer
+    GLint base_vertex = 0;          // added to every index, so indices stay local to the mesh
+    MeshLod lods[MESH_LOD_MAX];     // finest first
+    unsigned int lod_count = 1;
+    Bounds bounds;                  // [model units]
+};
+
+const unsigned char MESH_CULLED = 0xFF;  // in a MeshSelection, the mesh is outside the view frustum
+
+/// What one draw of a model shows: the level of detail of every mesh (in Model::meshes order) or
+// MESH_CULLED. Made per submit, so every copy of a model is culled and simplified on its own.
+using MeshSelection = vector<unsigned char>;
+
+/// Packed vertices and indices of a mesh to upload into an arena
+struct MeshData {
+    const void* vertex_data;
+    unsigned int vertex_count;
+    const unsigned int* index_data;
+    unsigned int index_count;
+};
+
+/// One VAO over a shared vertex buffer and index buffer holding several meshes of the same
+// VertexFormat, drawn with glDrawElementsBaseVertex so switching mesh needs no rebinding.
+class MeshArena
+{
+public:
+    VertexFormat format;
+    unsigned int VAO = 0;
+
+    // uploads all the meshes, mesh i starts at first_index(i) / base_vertex(i)
+    MeshArena(VertexFormat format, const vector<MeshData>& meshes)
     {
+        this->format = format;
+        for (MeshData const& mesh: meshes)
+        {
+            first_indices_.push_back(index_count_);
+            base_vertices_.push_back((GLint)vertex_count_);
+            vertex_count_ += mesh.vertex_count;
+            index_count_ += mesh.index_count;
+        }
+        setupArena(meshes);
+    }
 
-        QOpenGLFunctions_3_3_Core *functions = new QOpenGLFunctions_3_3_Core;
-        functions->initializeOpenGLFunctions();
+    // owns its GL objects, lives in a vector so it can be moved but not copied
+    MeshArena(const MeshArena&) = delete;
+    MeshArena& operator=(const MeshArena&) = delete;
 
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+    MeshArena(MeshArena&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MeshArena& operator=(MeshArena&& other) noexcept
+    {
+        if (this != &other)
         {
-            functions->glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            functions->glUniform1i(functions->glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            functions->glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            release();
+            format = other.format;
+            VAO = std::exchange(other.VAO, 0);
+            VBO = std::exchange(other.VBO, 0);
+            EBO = std::exchange(other.EBO, 0);
+            instance_buffer_ = std::exchange(other.instance_buffer_, 0);
+            vertex_count_ = other.vertex_count_;
+            index_count_ = other.index_count_;
+            first_indices_ = std::move(other.first_indices_);
+            base_vertices_ = std::move(other.base_vertices_);
         }
-        
-        // draw mesh
-        functions->glBindVertexArray(VAO);
-        functions->glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        functions->glBindVertexArray(0);
+        return *this;
+    }
+
+    ~MeshArena()
+    {
+        release();
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        functions->glActiveTexture(GL_TEXTURE0);
+    unsigned int first_index(size_t mesh) const { return first_indices_[mesh]; }
+    GLint base_vertex(size_t mesh) const { return base_vertices_[mesh]; }
 
-        delete functions;
+    // bytes the vertices would take with the full Vertex struct and take on the GPU
+    size_t unpacked_vertex_bytes() const { return size_t(vertex_count_)*sizeof(Vertex); }
+    size_t packed_vertex_bytes() const { return size_t(vertex_count_)*format.stride(); }
+    unsigned int vertex_count() const { return vertex_count_; }
+    size_t index_bytes() const { return size_t(index_count_)*sizeof(unsigned int); }
+
+    // Sources the instance model matrices (tightly packed glm::mat4) from buffer, once per buffer.
+    // Draw calls may happen in between so the bindings go through gl_state().
+    void set_instance_buffer(GLuint buffer)
+    {
+        if (instance_buffer_ == buffer)
+            return;
+        QOpenGLFunctions_3_3_Core functions;
+        functions.initializeOpenGLFunctions();
+        gl_state().bind_vertex_array(VAO);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, buffer);
+        for (GLuint column = 0; column < 4; column++)
+        {
+            functions.glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+            functions.glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                            (void*)(column*sizeof(glm::vec4)));
+            functions.glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+        }
+        instance_buffer_ = buffer;
     }
 
 private:
-    // render data 
-    unsigned int VBO, EBO;
+    // render data
+    unsigned int VBO = 0, EBO = 0;
+    GLuint instance_buffer_ = 0;
+    unsigned int vertex_count_ = 0;
+    unsigned int index_count_ = 0;
+    vector<unsigned int> first_indices_;
+    vector<GLint> base_vertices_;
+
+    // deletes the buffer objects/arrays (the instance buffer belongs to the model)
+    void release()
+    {
+        if (VAO == 0 && VBO == 0 && EBO == 0)
+            return;
+        QOpenGLFunctions_3_3_Core functions;
+        functions.initializeOpenGLFunctions();
+        gl_state().forget_vertex_array(VAO);
+        gl_state().forget_buffer(VBO);
+        gl_state().forget_buffer(EBO);
+        functions.glDeleteVertexArrays(1, &VAO);
+        functions.glDeleteBuffers(1, &VBO);
+        functions.glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+        instance_buffer_ = 0;
+    }
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupArena(const vector<MeshData>& meshes)
     {
-        QOpenGLFunctions_3_3_Core *functions = new QOpenGLFunctions_3_3_Core;
-        functions->initializeOpenGLFunctions();
+        QOpenGLFunctions_3_3_Core functions;
+        functions.initializeOpenGLFunctions();
 
         // create buffers/arrays
-        functions->glGenVertexArrays(1, &VAO);
-        functions->glGenBuffers(1, &VBO);
-        functions->glGenBuffers(1, &EBO);
+        functions.glGenVertexArrays(1, &VAO);
+        functions.glGenBuffers(1, &VBO);
+        functions.glGenBuffers(1, &EBO);
 
-        functions->glBindVertexArray(VAO);
-        // load data into vertex buffers
-        functions->glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        functions->glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        functions->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        functions->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        gl_state().bind_vertex_array(VAO);
+        // load data into vertex buffers, mesh after mesh
+        const GLsizei stride = format.stride();
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, VBO);
+        functions.glBufferData(GL_ARRAY_BUFFER, packed_vertex_bytes(), nullptr, GL_STATIC_DRAW);
+        gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        functions.glBufferData(GL_ELEMENT_ARRAY_BUFFER, size_t(index_count_)*sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            functions.glBufferSubData(GL_ARRAY_BUFFER, size_t(base_vertices_[i])*stride, size_t(meshes[i].vertex_count)*stride, meshes[i].vertex_data);
+            functions.glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, size_t(first_indices_[i])*sizeof(unsigned int),
+                            size_t(meshes[i].index_count)*sizeof(unsigned int), meshes[i].index_data);
+        }
 
         // set the vertex attribute pointers
         // vertex Positions
-        functions->glEnableVertexAttribArray(0);	
-        functions->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        functions.glEnableVertexAttribArray(0);
+        functions.glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
         // vertex normals
-        functions->glEnableVertexAttribArray(1);	
-        functions->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        if (format.normals)
+        {
+            functions.glEnableVertexAttribArray(1);
+            functions.glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)format.normal_offset());
+        }
         // vertex texture coords
-        functions->glEnableVertexAttribArray(2);	
-        functions->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        functions->glEnableVertexAttribArray(3);
-        functions->glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        functions->glEnableVertexAttribArray(4);
-        functions->glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		functions->glEnableVertexAttribArray(5);
-		functions->glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		functions->glEnableVertexAttribArray(6);
-		functions->glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        functions->glBindVertexArray(0);
-
-        delete functions;
+        if (format.texcoords)
+        {
+            functions.glEnableVertexAttribArray(2);
+            functions.glVertexAttribPointer(2, 2, format.half_texcoords ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (void*)(size_t)format.texcoords_offset());
+        }
+        // vertex tangent (bitangent sign in w)
+        if (format.tangents)
+        {
+            functions.glEnableVertexAttribArray(3);
+            functions.glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)format.tangent_offset());
+        }
+        if (format.bones)
+        {
+            // ids
+            functions.glEnableVertexAttribArray(5);
+            functions.glVertexAttribIPointer(5, 4, GL_UNSIGNED_SHORT, stride, (void*)(size_t)format.bones_offset());
+            // weights
+            functions.glEnableVertexAttribArray(6);
+            functions.glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(size_t)format.weights_offset());
+        }
+        gl_state().bind_vertex_array(0);
     }
 };
 #endif
@@ -0,0 +1,344 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <QFile>
+#include <QString>
+
+#include <general_inc/model_import.h>
+#include <general_inc/paths.h>
+#include <general_inc/profiler.h>
+#include <general_inc/utilities.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+const char MESH_CACHE_MAGIC[8] = {'G', 'L', 'Q', 'M', 'E', 'S', 'H', '\0'};
+const std::uint32_t MESH_CACHE_VERSION = 4;  // bump when the file layout, VertexFormat or the importer output changes
+const std::uint64_t MESH_CACHE_ALIGNMENT = 16;  // of every vertex and index blob
+
+/// Preprocessed model file, the output of import_model for one source file.
+// Layout (native endianness, all offsets from the start of the file):
+//   MeshCacheHeader
+//   MeshCacheRecord  [mesh_count]
+//   MeshCacheTexture [texture_count]
+//   string table (NUL terminated texture types and paths)
+//   vertex and index blobs, each aligned to MESH_CACHE_ALIGNMENT
+// The blobs are in GPU layout so a mapped file is handed straight to glBufferData.
+struct MeshCacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t mesh_count;
+    std::uint64_t source_key;  // mesh_cache_key of the source when the file was written
+    std::uint32_t texture_count;
+    std::uint32_t reserved;
+    std::uint64_t strings_offset;
+    std::uint64_t strings_size;
+    std::uint64_t file_size;
+};
+
+struct MeshCacheLod {
+    std::uint32_t first_index;  // from the record's first index
+    std::uint32_t index_count;
+    float error;
+    std::uint32_t reserved;
+};
+
+struct MeshCacheRecord {
+    std::uint64_t vertex_offset;
+    std::uint64_t index_offset;
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;  // of all the levels of detail
+    std::uint32_t format;  // VertexFormat bits, see encode_vertex_format
+    std::uint32_t first_texture;
+    std::uint32_t texture_count;
+    std::uint32_t lod_count;
+    float sphere[4];  // center and radius
+    float box[6];     // min and max corners
+    MeshCacheLod lods[MESH_LOD_MAX];
+};
+
+struct MeshCacheTexture {
+    std::uint32_t type_offset;  // into the string table
+    std::uint32_t path_offset;
+};
+
+std::uint32_t encode_vertex_format(const VertexFormat& format)
+{
+    return (format.normals ? 1u : 0u) | (format.texcoords ? 2u : 0u) | (format.half_texcoords ? 4u : 0u) |
+           (format.tangents ? 8u : 0u) | (format.bones ? 16u : 0u);
+}
+
+VertexFormat decode_vertex_format(std::uint32_t bits)
+{
+    VertexFormat format;
+    format.normals = bits & 1u;
+    format.texcoords = bits & 2u;
+    format.half_texcoords = bits & 4u;
+    format.tangents = bits & 8u;
+    format.bones = bits & 16u;
+    return format;
+}
+
+/// Hash of everything the import depends on: the source file, the material libraries next to it
+// (.mtl files are read by the OBJ importer), the import flags and the cache version.
+// Returns 0 if the source can't be read.
+std::uint64_t mesh_cache_key(const std::string& source_path, unsigned int import_flags = MODEL_IMPORT_FLAGS)
+{
+    PROFILE_SCOPE("mesh_cache_key");
+    auto hash_file = [](const std::string& path, std::uint64_t& key) {
+        QFile file(QString::fromStdString(path));
+        if (!file.open(QIODevice::ReadOnly)) { return false; }
+        if (file.size() > 0) {
+            const uchar* data = file.map(0, file.size());
+            if (data == nullptr) { return false; }
+            key = hash_bytes(data, static_cast<std::size_t>(file.size()), key);
+            file.unmap(const_cast<uchar*>(data));
+        }
+        return true;
+    };
+
+    std::uint64_t key = hash_bytes(&MESH_CACHE_VERSION, sizeof(MESH_CACHE_VERSION));
+    key = hash_bytes(&import_flags, sizeof(import_flags), key);
+    if (!hash_file(source_path, key)) { return 0; }
+
+    std::vector<std::string> materials;
+    try {
+        for (auto const& entry: fs::directory_iterator(fs::path(source_path).parent_path())) {
+            if (entry.path().extension() == ".mtl") { materials.push_back(entry.path().string()); }
+        }
+    }
+    catch (fs::filesystem_error&) {}
+    std::sort(materials.begin(), materials.end());  // directory order isn't stable
+    for (auto const& material: materials) {
+        hash_file(material, key);
+    }
+    return key;
+}
+
+/// Cache file of a source model, named after its canonical path so a stale file is replaced in place
+std::string mesh_cache_path(const std::string& cache_directory, const std::string& source_path)
+{
+    std::string canonical = canonical_path(source_path);
+    std::stringstream file_name;
+    file_name << std::hex << std::setw(16) << std::setfill('0') << hash_bytes(canonical.data(), canonical.size()) << ".mesh";
+    return (fs::path(cache_directory) / file_name.str()).string();
+}
+
+/// Writes meshes to cache_path (through a temporary file so readers never see a partial cache)
+bool write_mesh_cache(const std::string& cache_path, std::uint64_t source_key, const std::vector<ImportedMesh>& meshes)
+{
+    PROFILE_SCOPE("write_mesh_cache");
+    auto align = [](std::uint64_t offset) { return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT; };
+
+    std::vector<MeshCacheRecord> records(meshes.size());
+    std::vector<MeshCacheTexture> textures;
+    std::string strings;
+    auto add_string = [&strings](const std::string& text) {
+        std::uint32_t offset = static_cast<std::uint32_t>(strings.size());
+        strings.append(text);
+        strings.push_back('\0');
+        return offset;
+    };
+    for (std::size_t i = 0; i < meshes.size(); i++) {
+        records[i] = {};
+        records[i].vertex_count = meshes[i].vertex_count;
+        records[i].index_count = static_cast<std::uint32_t>(meshes[i].indices.size());
+        records[i].format = encode_vertex_format(meshes[i].format);
+        records[i].first_texture = static_cast<std::uint32_t>(textures.size());
+        records[i].texture_count = static_cast<std::uint32_t>(meshes[i].textures.size());
+        records[i].lod_count = static_cast<std::uint32_t>(meshes[i].lods.size());
+        for (std::size_t l = 0; l < meshes[i].lods.size(); l++) {
+            records[i].lods[l] = {meshes[i].lods[l].first_index, meshes[i].lods[l].index_count, meshes[i].lods[l].error, 0};
+        }
+        const Bounds& bounds = meshes[i].bounds;
+        std::memcpy(records[i].sphere, &bounds.sphere.center, sizeof(glm::vec3));
+        records[i].sphere[3] = bounds.sphere.radius;
+        std::memcpy(records[i].box, &bounds.box.min, sizeof(glm::vec3));
+        std::memcpy(records[i].box + 3, &bounds.box.max, sizeof(glm::vec3));
+        for (auto const& texture: meshes[i].textures) {
+            std::uint32_t type_offset = add_string(texture.type);
+            textures.push_back({type_offset, add_string(texture.path)});
+        }
+    }
+
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.mesh_count = static_cast<std::uint32_t>(meshes.size());
+    header.source_key = source_key;
+    header.texture_count = static_cast<std::uint32_t>(textures.size());
+    header.strings_offset = sizeof(MeshCacheHeader) + records.size()*sizeof(MeshCacheRecord) + textures.size()*sizeof(MeshCacheTexture);
+    header.strings_size = strings.size();
+    std::uint64_t offset = header.strings_offset + header.strings_size;
+    for (std::size_t i = 0; i < meshes.size(); i++) {
+        records[i].vertex_offset = offset = align(offset);
+        offset += meshes[i].vertex_data.size();
+        records[i].index_offset = offset = align(offset);
+        offset += meshes[i].indices.size()*sizeof(unsigned int);
+    }
+    header.file_size = offset;
+
+    try {
+        fs::create_directories(fs::path(cache_path).parent_path());
+    }
+    catch (fs::filesystem_error& e) {
+        std::cout << "ERROR::MESH_CACHE::DIRECTORY_NOT_CREATED " << e.what() << std::endl;
+        return false;
+    }
+    std::string temporary_path = cache_path + ".tmp";
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::MESH_CACHE::NOT_WRITTEN " << cache_path << std::endl;
+        return false;
+    }
+    auto pad_to = [&file](std::uint64_t target) {
+        static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+        file.write(zeros, static_cast<std::streamsize>(target - static_cast<std::uint64_t>(file.tellp())));
+    };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size()*sizeof(MeshCacheRecord));
+    file.write(reinterpret_cast<const char*>(textures.data()), textures.size()*sizeof(MeshCacheTexture));
+    file.write(strings.data(), strings.size());
+    for (std::size_t i = 0; i < meshes.size(); i++) {
+        pad_to(records[i].vertex_offset);
+        file.write(reinterpret_cast<const char*>(meshes[i].vertex_data.data()), meshes[i].vertex_data.size());
+        pad_to(records[i].index_offset);
+        file.write(reinterpret_cast<const char*>(meshes[i].indices.data()), meshes[i].indices.size()*sizeof(unsigned int));
+    }
+    file.close();
+    if (!file)
+    {
+        std::cout << "ERROR::MESH_CACHE::NOT_WRITTEN " << cache_path << std::endl;
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+
+    try {
+        fs::rename(fs::path(temporary_path), fs::path(cache_path));
+    }
+    catch (fs::filesystem_error& e) {
+        std::cout << "ERROR::MESH_CACHE::NOT_WRITTEN " << e.what() << std::endl;
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Read only memory mapping of a cache file, valid until destroyed
+class MeshCacheFile
+{
+public:
+    MeshCacheFile() = default;
+    MeshCacheFile(const MeshCacheFile&) = delete;
+    MeshCacheFile& operator=(const MeshCacheFile&) = delete;
+
+    ~MeshCacheFile()
+    {
+        if (data_ != nullptr) { file_.unmap(const_cast<uchar*>(data_)); }
+    }
+
+    // Maps cache_path, returns false if it is missing, corrupt or was written for another source_key
+    bool open(const std::string& cache_path, std::uint64_t source_key)
+    {
+        file_.setFileName(QString::fromStdString(cache_path));
+        if (!file_.open(QIODevice::ReadOnly) || file_.size() < static_cast<qint64>(sizeof(MeshCacheHeader))) { return false; }
+        data_ = file_.map(0, file_.size());
+        if (data_ == nullptr) { return false; }
+        size_ = static_cast<std::uint64_t>(file_.size());
+        return valid(source_key);
+    }
+
+    std::size_t mesh_count() const { return header().mesh_count; }
+    const MeshCacheRecord& record(std::size_t mesh) const { return records()[mesh]; }
+    VertexFormat format(std::size_t mesh) const { return decode_vertex_format(record(mesh).format); }
+    const void* vertex_data(std::size_t mesh) const { return data_ + record(mesh).vertex_offset; }
+    const unsigned int* index_data(std::size_t mesh) const
+    {
+        return reinterpret_cast<const unsigned int*>(data_ + record(mesh).index_offset);
+    }
+
+    std::vector<MeshLod> lods(std::size_t mesh) const
+    {
+        std::vector<MeshLod> levels;
+        for (std::uint32_t l = 0; l < record(mesh).lod_count; l++) {
+            const MeshCacheLod& lod = record(mesh).lods[l];
+            levels.push_back({lod.first_index, lod.index_count, lod.error});
+        }
+        return levels;
+    }
+
+    Bounds bounds(std::size_t mesh) const
+    {
+        Bounds bounds;
+        const MeshCacheRecord& r = record(mesh);
+        bounds.sphere = {glm::vec3(r.sphere[0], r.sphere[1], r.sphere[2]), r.sphere[3]};
+        bounds.box.min = glm::vec3(r.box[0], r.box[1], r.box[2]);
+        bounds.box.max = glm::vec3(r.box[3], r.box[4], r.box[5]);
+        return bounds;
+    }
+
+    std::vector<TextureReference> textures(std::size_t mesh) const
+    {
+        std::vector<TextureReference> references;
+        const MeshCacheTexture* table = reinterpret_cast<const MeshCacheTexture*>(records() + header().mesh_count);
+        for (std::uint32_t i = 0; i < record(mesh).texture_count; i++) {
+            const MeshCacheTexture& texture = table[record(mesh).first_texture + i];
+            references.push_back({string_at(texture.type_offset), string_at(texture.path_offset)});
+        }
+        return references;
+    }
+
+private:
+    const MeshCacheHeader& header() const { return *reinterpret_cast<const MeshCacheHeader*>(data_); }
+    const MeshCacheRecord* records() const { return reinterpret_cast<const MeshCacheRecord*>(data_ + sizeof(MeshCacheHeader)); }
+    const char* string_at(std::uint32_t offset) const
+    {
+        return reinterpret_cast<const char*>(data_ + header().strings_offset + offset);
+    }
+
+    // Checks every offset once so the accessors don't have to
+    bool valid(std::uint64_t source_key) const
+    {
+        const MeshCacheHeader& h = header();
+        if (std::memcmp(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic)) != 0 || h.version != MESH_CACHE_VERSION ||
+            h.source_key != source_key || h.file_size != size_) { return false; }
+
+        std::uint64_t tables_end = sizeof(MeshCacheHeader) + std::uint64_t(h.mesh_count)*sizeof(MeshCacheRecord) +
+                                   std::uint64_t(h.texture_count)*sizeof(MeshCacheTexture);
+        if (tables_end > size_ || h.strings_offset != tables_end || h.strings_offset + h.strings_size > size_) { return false; }
+        if (h.strings_size > 0 && data_[h.strings_offset + h.strings_size - 1] != '\0') { return false; }
+
+        const MeshCacheTexture* textures = reinterpret_cast<const MeshCacheTexture*>(records() + h.mesh_count);
+        for (std::uint32_t i = 0; i < h.texture_count; i++) {
+            if (textures[i].type_offset >= h.strings_size || textures[i].path_offset >= h.strings_size) { return false; }
+        }
+        for (std::uint32_t i = 0; i < h.mesh_count; i++) {
+            const MeshCacheRecord& r = records()[i];
+            std::uint64_t vertex_bytes = std::uint64_t(r.vertex_count)*decode_vertex_format(r.format).stride();
+            std::uint64_t index_bytes = std::uint64_t(r.index_count)*sizeof(unsigned int);
+            if (r.vertex_offset % MESH_CACHE_ALIGNMENT != 0 || r.index_offset % MESH_CACHE_ALIGNMENT != 0 ||
+                r.vertex_offset + vertex_bytes > size_ || r.index_offset + index_bytes > size_ ||
+                std::uint64_t(r.first_texture) + r.texture_count > h.texture_count) { return false; }
+            if (r.lod_count < 1 || r.lod_count > MESH_LOD_MAX) { return false; }
+            for (std::uint32_t l = 0; l < r.lod_count; l++) {
+                if (std::uint64_t(r.lods[l].first_index) + r.lods[l].index_count > r.index_count) { return false; }
+            }
+        }
+        return true;
+    }
+
+    QFile file_;
+    const uchar* data_ = nullptr;
+    std::uint64_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <glm/glm.hpp>
+
+#include <general_inc/profiler.h>
+#include <general_inc/utilities.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Import-time optimization of indexed triangle meshes, done once and stored in the mesh cache.
+// Works on interleaved vertex bytes with the position (3 x float) first, as VertexFormat packs them.
+// No OpenGL needed, the functions are safe to run on worker threads (one mesh per thread).
+
+const unsigned int VERTEX_CACHE_ANALYSIS_SIZE = 16;  // FIFO entries simulated for ACMR/ATVR (a conservative post-transform cache)
+const unsigned int FORSYTH_CACHE_SIZE = 32;          // LRU entries modelled by the triangle ordering
+const float OVERDRAW_THRESHOLD = 1.05f;              // ACMR the overdraw ordering may lose, relative to the cache order
+
+/// FIFO post-transform vertex cache, vertices are tagged with the time they entered it
+class VertexCacheSimulator
+{
+public:
+    VertexCacheSimulator(unsigned int vertex_count, unsigned int cache_size):
+        entered_(vertex_count, 0), cache_size_(cache_size), time_(cache_size + 1) {}
+
+    // Cache misses of one triangle (0 to 3)
+    unsigned int add_triangle(unsigned int a, unsigned int b, unsigned int c)
+    {
+        return add_vertex(a) + add_vertex(b) + add_vertex(c);
+    }
+
+    // Empty cache
+    void reset()
+    {
+        time_ += cache_size_ + 1;
+    }
+
+private:
+    unsigned int add_vertex(unsigned int vertex)
+    {
+        if (time_ - entered_[vertex] <= cache_size_) { return 0; }
+        entered_[vertex] = time_++;
+        return 1;
+    }
+
+    std::vector<unsigned int> entered_;
+    unsigned int cache_size_;
+    unsigned int time_;
+};
+
+/// Vertex transforms an index order costs
+struct VertexCacheStatistics {
+    unsigned int misses = 0;
+    unsigned int triangles = 0;
+    unsigned int vertices = 0;
+
+    double acmr() const { return triangles > 0 ? double(misses)/triangles : 0.0; }  // average cache miss ratio, 0.5 at best
+    double atvr() const { return vertices > 0 ? double(misses)/vertices : 0.0; }    // average transformed vertex ratio, 1 at best
+
+    VertexCacheStatistics& operator+=(const VertexCacheStatistics& other)
+    {
+        misses += other.misses;
+        triangles += other.triangles;
+        vertices += other.vertices;
+        return *this;
+    }
+};
+
+VertexCacheStatistics analyze_vertex_cache(const std::vector<unsigned int>& indices, unsigned int vertex_count,
+                                           unsigned int cache_size = VERTEX_CACHE_ANALYSIS_SIZE)
+{
+    VertexCacheStatistics statistics;
+    statistics.triangles = indices.size()/3;
+    statistics.vertices = vertex_count;
+    VertexCacheSimulator cache(vertex_count, cache_size);
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        statistics.misses += cache.add_triangle(indices[i], indices[i + 1], indices[i + 2]);
+    }
+    return statistics;
+}
+
+// Merges the vertices whose bytes are identical (after packing, so vertices that only differ
+// below the packed precision merge too) and remaps the indices. Returns the new vertex count.
+unsigned int weld_vertices(std::vector<unsigned char>& vertex_data, unsigned int vertex_count, std::size_t stride,
+                           std::vector<unsigned int>& indices)
+{
+    const unsigned int EMPTY = ~0u;
+    std::size_t table_size = 1;
+    while (table_size < 2*std::size_t(vertex_count)) { table_size *= 2; }
+    std::vector<unsigned int> table(table_size, EMPTY);  // open addressing, linear probing: slot -> welded vertex
+
+    std::vector<unsigned int> remap(vertex_count);
+    unsigned int welded_count = 0;
+    for (unsigned int v = 0; v < vertex_count; v++) {
+        const unsigned char* vertex = &vertex_data[v*stride];
+        std::size_t slot = hash_bytes(vertex, stride) & (table_size - 1);
+        while (table[slot] != EMPTY && std::memcmp(&vertex_data[table[slot]*stride], vertex, stride) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == EMPTY) {
+            // welded vertices are compacted in place, welded_count <= v so nothing unread is overwritten
+            if (welded_count != v) { std::memcpy(&vertex_data[welded_count*stride], vertex, stride); }
+            table[slot] = welded_count++;
+        }
+        remap[v] = table[slot];
+    }
+
+    for (unsigned int& index: indices) { index = remap[index]; }
+    vertex_data.resize(welded_count*stride);
+    return welded_count;
+}
+
+// Triangle order for the post-transform cache, Tom Forsyth's "Linear-Speed Vertex Cache
+// Optimisation": each step emits the best scored triangle using the vertices in a modelled LRU
+// cache, the score favouring recently used vertices and vertices with few triangles left.
+void optimize_vertex_cache(std::vector<unsigned int>& indices, unsigned int vertex_count)
+{
+    const std::size_t triangle_count = indices.size()/3;
+    if (triangle_count == 0) { return; }
+
+    auto vertex_score = [](int cache_position, unsigned int remaining) {
+        if (remaining == 0) { return -1.0f; }
+        float score = 0.0f;
+        if (cache_position >= 0) {
+            // the last triangle's vertices score the same so its orientation doesn't matter
+            score = cache_position < 3 ? 0.75f
+                  : std::pow(1.0f - float(cache_position - 3)/(FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f/std::sqrt(float(remaining));  // valence boost, finishes off lonely vertices
+    };
+
+    // triangles of every vertex (compressed rows)
+    std::vector<unsigned int> remaining(vertex_count, 0);
+    for (unsigned int index: indices) { remaining[index]++; }
+    std::vector<unsigned int> first_triangle(vertex_count + 1, 0);
+    for (unsigned int v = 0; v < vertex_count; v++) { first_triangle[v + 1] = first_triangle[v] + remaining[v]; }
+    std::vector<unsigned int> vertex_triangles(indices.size());
+    std::vector<unsigned int> filled(first_triangle.begin(), first_triangle.end() - 1);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) { vertex_triangles[filled[indices[3*t + k]]++] = t; }
+    }
+
+    std::vector<float> score(vertex_count);
+    for (unsigned int v = 0; v < vertex_count; v++) { score[v] = vertex_score(-1, remaining[v]); }
+    std::vector<float> triangle_score(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+        triangle_score[t] = score[indices[3*t]] + score[indices[3*t + 1]] + score[indices[3*t + 2]];
+    }
+    std::vector<bool> emitted(triangle_count, false);
+
+    std::vector<unsigned int> cache, next_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    std::vector<unsigned int> optimized;
+    optimized.reserve(indices.size());
+
+    std::size_t scan = 0;  // no triangle before this one is left (for restarts when the cache has nothing to offer)
+    long best = -1;
+    while (optimized.size() < 3*triangle_count)
+    {
+        if (best < 0) {
+            // the cache touches no triangle left, take the first one remaining
+            while (emitted[scan]) { scan++; }
+            best = scan;
+        }
+
+        const unsigned int* triangle = &indices[3*best];
+        optimized.insert(optimized.end(), triangle, triangle + 3);
+        emitted[best] = true;
+
+        // the triangle's vertices move to the front of the cache, the others shift back
+        next_cache.assign(triangle, triangle + 3);
+        for (unsigned int v: cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) { next_cache.push_back(v); }
+        }
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = triangle[k];
+            remaining[v]--;
+            // swap the emitted triangle out of the vertex's live range
+            unsigned int* begin = &vertex_triangles[first_triangle[v]];
+            unsigned int* end = begin + remaining[v] + 1;
+            std::iter_swap(std::find(begin, end, (unsigned int)best), end - 1);
+        }
+
+        // rescore the vertices in (or just pushed out of) the cache and their triangles
+        for (std::size_t i = 0; i < next_cache.size(); i++) {
+            unsigned int v = next_cache[i];
+            float new_score = vertex_score(i < FORSYTH_CACHE_SIZE ? int(i) : -1, remaining[v]);
+            float delta = new_score - score[v];
+            score[v] = new_score;
+            for (unsigned int j = first_triangle[v]; j < first_triangle[v] + remaining[v]; j++) {
+                triangle_score[vertex_triangles[j]] += delta;
+            }
+        }
+        if (next_cache.size() > FORSYTH_CACHE_SIZE) { next_cache.resize(FORSYTH_CACHE_SIZE); }
+        cache.swap(next_cache);
+
+        // the next triangle is the best one using a cached vertex
+        best = -1;
+        float best_score = -1.0f;
+        for (unsigned int v: cache) {
+            for (unsigned int j = first_triangle[v]; j < first_triangle[v] + remaining[v]; j++) {
+                unsigned int t = vertex_triangles[j];
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(optimized);
+}
+
+// Reorders clusters of the cache optimized triangles so that the ones facing away from the mesh
+// center (likely to occlude the rest) are drawn first, after Sander et al. "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw". Clusters are cut where the cache restarts
+// anyway and further as long as their ACMR stays within threshold of the cache order.
+void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<unsigned char>& vertex_data,
+                       unsigned int vertex_count, std::size_t stride, float threshold = OVERDRAW_THRESHOLD)
+{
+    const std::size_t triangle_count = indices.size()/3;
+    if (triangle_count < 2) { return; }
+
+    auto position = [&](unsigned int vertex) {
+        glm::vec3 p;
+        std::memcpy(&p, &vertex_data[vertex*stride], sizeof(p));
+        return p;
+    };
+
+    // hard boundaries: the triangle misses all its vertices, the cache starts over there
+    VertexCacheSimulator cache(vertex_count, VERTEX_CACHE_ANALYSIS_SIZE);
+    std::vector<std::size_t> hard = {0};
+    for (std::size_t t = 0; t < triangle_count; t++) {
+        if (cache.add_triangle(indices[3*t], indices[3*t + 1], indices[3*t + 2]) == 3 && t > 0) { hard.push_back(t); }
+    }
+    hard.push_back(triangle_count);
+
+    // soft boundaries: cut a cluster as soon as its ACMR is as good as allowed
+    std::vector<std::size_t> clusters;
+    for (std::size_t h = 0; h + 1 < hard.size(); h++) {
+        std::size_t start = hard[h], end = hard[h + 1];
+        cache.reset();
+        unsigned int cluster_misses = 0;
+        for (std::size_t t = start; t < end; t++) {
+            cluster_misses += cache.add_triangle(indices[3*t], indices[3*t + 1], indices[3*t + 2]);
+        }
+        float cluster_threshold = threshold*float(cluster_misses)/float(end - start);
+
+        clusters.push_back(start);
+        cache.reset();
+        unsigned int running_misses = 0, running_triangles = 0;
+        for (std::size_t t = start; t < end; t++) {
+            running_misses += cache.add_triangle(indices[3*t], indices[3*t + 1], indices[3*t + 2]);
+            running_triangles++;
+            if (float(running_misses)/running_triangles <= cluster_threshold && t + 1 < end) {
+                clusters.push_back(t + 1);
+                cache.reset();
+                running_misses = running_triangles = 0;
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    // mesh and cluster centroids, area weighted (the cross products are twice the areas)
+    glm::dvec3 mesh_centroid(0.0);
+    double mesh_area = 0.0;
+    std::vector<glm::vec3> cluster_centroid(clusters.size() - 1), cluster_normal(clusters.size() - 1);
+    for (std::size_t c = 0; c + 1 < clusters.size(); c++) {
+        glm::dvec3 centroid(0.0), normal(0.0);
+        double area = 0.0;
+        for (std::size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            glm::vec3 a = position(indices[3*t]), b = position(indices[3*t + 1]), d = position(indices[3*t + 2]);
+            glm::dvec3 cross = glm::dvec3(glm::cross(b - a, d - a));
+            double triangle_area = glm::length(cross);
+            centroid += glm::dvec3(a + b + d)*(triangle_area/3.0);
+            normal += cross;
+            area += triangle_area;
+        }
+        mesh_centroid += centroid;
+        mesh_area += area;
+        cluster_centroid[c] = area > 0.0 ? glm::vec3(centroid/area) : position(indices[3*clusters[c]]);
+        cluster_normal[c] = glm::length(normal) > 0.0 ? glm::vec3(glm::normalize(normal)) : glm::vec3(0.0f);
+    }
+    if (mesh_area > 0.0) { mesh_centroid /= mesh_area; }
+
+    std::vector<float> facing(clusters.size() - 1);
+    std::vector<std::size_t> order(clusters.size() - 1);
+    for (std::size_t c = 0; c < order.size(); c++) {
+        facing[c] = glm::dot(cluster_centroid[c] - glm::vec3(mesh_centroid), cluster_normal[c]);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return facing[a] > facing[b]; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (std::size_t c: order) {
+        sorted.insert(sorted.end(), indices.begin() + 3*clusters[c], indices.begin() + 3*clusters[c + 1]);
+    }
+    indices.swap(sorted);
+}
+
+// Renumbers the vertices in the order the indices first use them, so vertex fetches walk
+// the buffer forward. Unreferenced vertices are dropped, returns the new vertex count.
+unsigned int optimize_vertex_fetch(std::vector<unsigned char>& vertex_data, unsigned int vertex_count, std::size_t stride,
+                                   std::vector<unsigned int>& indices)
+{
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertex_count, UNUSED);
+    std::vector<unsigned char> reordered(vertex_data.size());
+    unsigned int next = 0;
+    for (unsigned int& index: indices) {
+        if (remap[index] == UNUSED) {
+            std::memcpy(&reordered[next*stride], &vertex_data[index*stride], stride);
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    reordered.resize(next*stride);
+    vertex_data.swap(reordered);
+    return next;
+}
+
+/// Effect of optimize_mesh on one mesh
+struct MeshOptimization {
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+};
+
+// The whole pipeline: weld, cache order, overdraw order, fetch order
+MeshOptimization optimize_mesh(std::vector<unsigned char>& vertex_data, unsigned int& vertex_count, std::size_t stride,
+                               std::vector<unsigned int>& indices)
+{
+    PROFILE_SCOPE("optimize_mesh");
+    MeshOptimization result;
+    result.before = analyze_vertex_cache(indices, vertex_count);
+    vertex_count = weld_vertices(vertex_data, vertex_count, stride, indices);
+    optimize_vertex_cache(indices, vertex_count);
+    optimize_overdraw(indices, vertex_data, vertex_count, stride);
+    vertex_count = optimize_vertex_fetch(vertex_data, vertex_count, stride, indices);
+    result.after = analyze_vertex_cache(indices, vertex_count);
+    return result;
+}
+
+#endif
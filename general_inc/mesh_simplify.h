@@ -0,0 +1,233 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include <general_inc/profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Level of detail generation by quadric edge collapse (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics"), done at import. A collapse moves a vertex onto
+// one of its neighbours, so the simplified levels are new index lists over the original vertices
+// and every level shares the vertex buffer. Works on interleaved vertex bytes with the position
+// (3 x float) first, as VertexFormat packs them. No OpenGL needed.
+
+/// Sum of squared distances to a set of planes, weighted by area (symmetric 4x4 matrix)
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    Quadric() = default;
+
+    // Plane through point with unit normal, weighted
+    Quadric(const glm::dvec3& normal, const glm::dvec3& point, double weight)
+    {
+        double d = -glm::dot(normal, point);
+        a2 = weight*normal.x*normal.x; ab = weight*normal.x*normal.y; ac = weight*normal.x*normal.z; ad = weight*normal.x*d;
+        b2 = weight*normal.y*normal.y; bc = weight*normal.y*normal.z; bd = weight*normal.y*d;
+        c2 = weight*normal.z*normal.z; cd = weight*normal.z*d;
+        d2 = weight*d*d;
+        this->weight = weight;
+    }
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+        weight += q.weight;
+        return *this;
+    }
+
+    // Mean squared distance of p to the planes (weighted by their areas)
+    double error(const glm::dvec3& p) const
+    {
+        if (weight <= 0) { return 0.0; }
+        double e = a2*p.x*p.x + 2*ab*p.x*p.y + 2*ac*p.x*p.z + 2*ad*p.x
+                 + b2*p.y*p.y + 2*bc*p.y*p.z + 2*bd*p.y
+                 + c2*p.z*p.z + 2*cd*p.z
+                 + d2;
+        return std::max(e, 0.0)/weight;
+    }
+};
+
+/// A simplified index list and how far it strays from the source surface
+struct SimplifiedMesh {
+    std::vector<unsigned int> indices;
+    float error = 0.0f;  // largest collapse error, as a distance in model units
+};
+
+// Simplifies the triangles to each of the target ratios of their count (decreasing ratios, eg.
+// 0.5, 0.25, 0.1), continuing from one level to the next so the errors are measured against the
+// source. Vertices on open borders and on attribute seams (several vertices at one position) are
+// locked, so holes don't grow and UV/normal seams don't tear. Stops early when every remaining
+// collapse is locked or would flip a triangle, the coarser levels then repeat the last one.
+std::vector<SimplifiedMesh> simplify_lods(const std::vector<unsigned int>& indices, const std::vector<unsigned char>& vertex_data,
+                                          unsigned int vertex_count, std::size_t stride, const std::vector<float>& ratios)
+{
+    PROFILE_SCOPE("simplify_lods");
+    std::vector<glm::dvec3> positions(vertex_count);
+    for (unsigned int v = 0; v < vertex_count; v++) {
+        glm::vec3 p;
+        std::memcpy(&p, &vertex_data[v*stride], sizeof(p));
+        positions[v] = glm::dvec3(p);
+    }
+
+    // seams: vertices sharing a position with another vertex
+    std::vector<bool> locked(vertex_count, false);
+    {
+        struct PositionHash {
+            std::size_t operator()(const glm::dvec3& p) const
+            {
+                std::size_t h = std::hash<double>()(p.x);
+                h = h*31 + std::hash<double>()(p.y);
+                return h*31 + std::hash<double>()(p.z);
+            }
+        };
+        std::unordered_map<glm::dvec3, unsigned int, PositionHash> first_at;
+        first_at.reserve(vertex_count);
+        for (unsigned int v = 0; v < vertex_count; v++) {
+            auto inserted = first_at.emplace(positions[v], v);
+            if (!inserted.second) {
+                locked[v] = true;
+                locked[inserted.first->second] = true;
+            }
+        }
+    }
+
+    // borders: edges of a single triangle
+    {
+        std::unordered_map<std::uint64_t, unsigned int> edge_count;
+        edge_count.reserve(indices.size());
+        auto edge_key = [](unsigned int a, unsigned int b) { return (std::uint64_t(std::min(a, b)) << 32) | std::max(a, b); };
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+            for (int k = 0; k < 3; k++) { edge_count[edge_key(indices[i + k], indices[i + (k + 1)%3])]++; }
+        }
+        for (auto const& edge: edge_count) {
+            if (edge.second == 1) {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xffffffffu] = true;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::dvec3& a = positions[indices[i]];
+        glm::dvec3 normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+        double length = glm::length(normal);
+        if (length == 0.0) { continue; }
+        Quadric plane(normal/length, a, 0.5*length);
+        for (int k = 0; k < 3; k++) { quadrics[indices[i + k]] += plane; }
+    }
+
+    struct Collapse {
+        unsigned int from, to;
+        double cost;
+    };
+
+    std::vector<SimplifiedMesh> levels;
+    std::vector<unsigned int> current = indices;
+    double max_error = 0.0;
+    std::vector<unsigned int> triangle_count(vertex_count), first_triangle(vertex_count + 1), vertex_triangles;
+    std::vector<unsigned int> remap(vertex_count);
+    std::vector<bool> touched(vertex_count);
+    std::vector<Collapse> collapses;
+
+    for (float ratio: ratios)
+    {
+        const std::size_t target = std::size_t(ratio*(indices.size()/3));
+        while (current.size()/3 > target)
+        {
+            // triangles around every vertex
+            std::fill(triangle_count.begin(), triangle_count.end(), 0);
+            for (unsigned int index: current) { triangle_count[index]++; }
+            first_triangle[0] = 0;
+            for (unsigned int v = 0; v < vertex_count; v++) { first_triangle[v + 1] = first_triangle[v] + triangle_count[v]; }
+            vertex_triangles.resize(current.size());
+            std::vector<unsigned int> filled(first_triangle.begin(), first_triangle.end() - 1);
+            for (std::size_t t = 0; t < current.size()/3; t++) {
+                for (int k = 0; k < 3; k++) { vertex_triangles[filled[current[3*t + k]]++] = t; }
+            }
+
+            // cheapest collapses first, moving the vertex onto its neighbour
+            collapses.clear();
+            for (std::size_t i = 0; i < current.size(); i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    unsigned int a = current[i + k], b = current[i + (k + 1)%3];
+                    Quadric q = quadrics[a];
+                    q += quadrics[b];
+                    if (!locked[a]) { collapses.push_back({a, b, q.error(positions[b])}); }
+                    if (!locked[b]) { collapses.push_back({b, a, q.error(positions[a])}); }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+            // apply the collapses that don't touch each other's neighbourhoods, up to the target
+            for (unsigned int v = 0; v < vertex_count; v++) { remap[v] = v; }
+            std::fill(touched.begin(), touched.end(), false);
+            std::size_t remaining = current.size()/3;
+            bool collapsed = false;
+            for (Collapse const& collapse: collapses)
+            {
+                if (remaining <= target) { break; }
+                if (touched[collapse.from] || touched[collapse.to]) { continue; }
+
+                // reject if a triangle kept around the moved vertex would turn over
+                bool flips = false;
+                std::size_t removed = 0;
+                for (unsigned int j = first_triangle[collapse.from]; j < first_triangle[collapse.from + 1] && !flips; j++) {
+                    const unsigned int* triangle = &current[3*vertex_triangles[j]];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        removed++;
+                        continue;
+                    }
+                    glm::dvec3 before[3], after[3];
+                    for (int k = 0; k < 3; k++) {
+                        before[k] = positions[triangle[k]];
+                        after[k] = triangle[k] == collapse.from ? positions[collapse.to] : before[k];
+                    }
+                    glm::dvec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::dvec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    flips = glm::dot(normal_before, normal_after) <= 0.0;
+                }
+                if (flips) { continue; }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                for (unsigned int j = first_triangle[collapse.from]; j < first_triangle[collapse.from + 1]; j++) {
+                    const unsigned int* triangle = &current[3*vertex_triangles[j]];
+                    for (int k = 0; k < 3; k++) { touched[triangle[k]] = true; }
+                }
+                max_error = std::max(max_error, collapse.cost);
+                remaining -= std::min(removed, remaining);
+                collapsed = true;
+            }
+            if (!collapsed) { break; }
+
+            // drop the triangles that became degenerate
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < current.size(); i += 3) {
+                unsigned int a = remap[current[i]], b = remap[current[i + 1]], c = remap[current[i + 2]];
+                if (a == b || b == c || a == c) { continue; }
+                current[kept++] = a;
+                current[kept++] = b;
+                current[kept++] = c;
+            }
+            current.resize(kept);
+        }
+
+        SimplifiedMesh level;
+        level.indices = current;
+        level.error = float(std::sqrt(max_error));
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+#endif
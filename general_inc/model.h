@@ -4,16 +4,22 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb_image.h>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 
 #include <general_inc/mesh.h>
+#include <general_inc/mesh_cache.h>
+#include <general_inc/model_import.h>
 #include <general_inc/shader.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/profiler.h>
+#include <general_inc/texture_cache.h>
+#include <general_inc/utilities.h>
 
 #include <QOpenGLContext>
 #include <QOpenGLFunctions_3_3_Core>
 
+#include <algorithm>
+#include <limits>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -22,233 +28,391 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
-
-class Model
+class Model: protected QOpenGLFunctions_3_3_Core
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-    vector<Mesh>    meshes;
+    vector<Texture> textures_loaded;	// distinct textures used by the model (TextureCache makes sure files aren't loaded more than once)
+    vector<Mesh>      meshes;     // sorted by arena then material
+    vector<MeshArena> arenas;     // one per vertex format used by the meshes (almost always one)
+    vector<Material>  materials;  // distinct texture sets of the meshes
     string directory;
     bool gammaCorrection;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
     {
+        initializeOpenGLFunctions();   // Initialise current context  (required)
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    ~Model()
+    {
+        if (instance_vbo_ != 0)
+        {
+            gl_state().forget_buffer(instance_vbo_);
+            glDeleteBuffers(1, &instance_vbo_);
+        }
+    }
+
+    // draws the model, and thus all its meshes at full detail. The vertex array and the textures are only
+    // bound when they change, which the mesh order keeps to once per arena and material.
     void Draw(Shader &shader)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        drawMeshes(shader, nullptr, 0);
     }
-    
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    // draws the meshes the selection keeps, each at its level of detail (see submit)
+    void Draw(Shader &shader, const MeshSelection& selection)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        drawMeshes(shader, selection.data(), 0);
+    }
+
+    // draws count copies of the model with one draw call per mesh, copy i placed by model_matrices[i].
+    // The shader reads the matrix from the instance attributes (see model_loading_instanced.vs). The copies
+    // aren't culled, every mesh is drawn at full detail or at the levels of selection (one per mesh, see
+    // MeshSelection) when one is given.
+    // The matrices are copied to a buffer of the model's, orphaned on every call so the driver
+    // doesn't wait for the previous draws.
+    void DrawInstanced(Shader &shader, const glm::mat4* model_matrices, size_t count, const unsigned char* selection = nullptr)
+    {
+        if (count == 0)
             return;
-        }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        if (instance_vbo_ == 0)
+            glGenBuffers(1, &instance_vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, instance_vbo_);
+        instance_capacity_ = std::max(instance_capacity_, count);
+        glBufferData(GL_ARRAY_BUFFER, instance_capacity_*sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count*sizeof(glm::mat4), model_matrices);
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        for (MeshArena& arena: arenas)
+            arena.set_instance_buffer(instance_vbo_);
+        drawMeshes(shader, selection, (GLsizei)count);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void DrawInstanced(Shader &shader, const vector<glm::mat4>& model_matrices)
     {
-        // process each mesh located at the current node
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        DrawInstanced(shader, model_matrices.data(), model_matrices.size());
+    }
+
+    // Queue the draw (binds shader and sets its "model" uniform), sorted by program and first texture.
+    // The matrix and the levels of detail go to the queue's buffers for the frame, so one model can be
+    // submitted several times per frame and the queued closure stays small enough not to allocate.
+    void submit(RenderQueue& queue, Shader& shader, glm::mat4 model_matrix)
+    {
+        // meshes outside the view frustum aren't drawn, the whole model isn't queued when none is left
+        select_lods(model_matrix, selection_);
+        bool any_visible = false;
+        for (size_t i = 0; i < meshes.size(); i++)
         {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            // meshes.push_back(processMesh(mesh, scene));
-            Mesh processed_mesh = processMesh(mesh, scene);
-            meshes.push_back(processed_mesh);
-            
+            if (queue.visible(meshes[i].bounds, model_matrix))
+                any_visible = true;
+            else
+                selection_[i] = MESH_CULLED;
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        if (!any_visible)
+            return;
+        glm::vec3 position = glm::vec3(model_matrix * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        GLuint texture = textures_loaded.empty() ? 0 : textures_loaded[0].id;
+        Shader* program = &shader;
+        queue.submit(RenderPass::OPAQUE, "models", shader.ID, texture, position, &model_matrix, 1, selection_.data(), selection_.size(),
+                     [this, program](const DrawParameters& parameters) {
+            program->use();
+            program->setMat4("model", parameters.matrices[0]);
+            drawMeshes(*program, parameters.bytes, 0);
+        });
+    }
+    
+    // Geometry only, the textures are shared through the TextureCache. Meshes keep no CPU copy
+    // of their vertices once uploaded (the mesh cache or the import is the source).
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(meshes) + heap_bytes(arenas) + heap_bytes(materials) + heap_bytes(textures_loaded);
+        for (Material const& material: materials) { usage.cpu_bytes += heap_bytes(material.bindings()); }
+        for (MeshArena const& arena: arenas) { usage.gpu_bytes += arena.packed_vertex_bytes() + arena.index_bytes(); }
+        usage.gpu_bytes += instance_capacity_*sizeof(glm::mat4);
+        return usage;
+    }
+
+    // Queue an instanced draw (see DrawInstanced), the levels of detail follow the copy nearest to the
+    // camera. The matrices are copied to the queue.
+    void submit_instanced(RenderQueue& queue, Shader& shader, const vector<glm::mat4>& model_matrices)
+    {
+        if (model_matrices.empty())
+            return;
+        const glm::vec3 eye = glm::vec3(glm::inverse(CameraBlock::instance().data().view)[3]);
+        size_t nearest = 0;
+        float nearest_distance = std::numeric_limits<float>::max();
+        for (size_t i = 0; i < model_matrices.size(); i++)
         {
-            processNode(node->mChildren[i], scene);
+            float distance = glm::length(glm::vec3(model_matrices[i][3]) - eye);
+            if (distance < nearest_distance)
+            {
+                nearest = i;
+                nearest_distance = distance;
+            }
         }
+        select_lods(model_matrices[nearest], selection_);
 
+        glm::vec3 position = glm::vec3(model_matrices[nearest][3]);
+        GLuint texture = textures_loaded.empty() ? 0 : textures_loaded[0].id;
+        Shader* program = &shader;
+        queue.submit(RenderPass::OPAQUE, "models instanced", shader.ID, texture, position, model_matrices.data(), model_matrices.size(),
+                     selection_.data(), selection_.size(), [this, program](const DrawParameters& parameters) {
+            program->use();
+            DrawInstanced(*program, parameters.matrices, parameters.matrix_count, parameters.bytes);
+        });
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // Picks the level of detail of every mesh (into selection) from its error projected on screen, with the camera of the
+    // CameraBlock (uploaded for the frame before the layers submit). A mesh switches to a coarser level
+    // once that level's error is below LOD_HYSTERESIS of the allowed error, and back to a finer one as
+    // soon as its error is above it, so a camera hovering around a threshold doesn't make it pop. The
+    // levels start from the previous selection of the model; copies of a model share that starting
+    // point only, each one gets the levels for its own distance.
+    void select_lods(const glm::mat4& model_matrix, MeshSelection& selection)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        lod_hint_.resize(meshes.size(), 0);
+        selection.assign(meshes.size(), 0);
+        const CameraBlockData& camera = CameraBlock::instance().data();
+        const glm::vec3 eye = glm::vec3(glm::inverse(camera.view)[3]);
+        const bool perspective = camera.projection[3][3] == 0.0f;
+        const float pixels_per_unit = 0.5f*camera.viewport.y*camera.projection[1][1];  // at distance 1 in perspective
+        const float scale = std::max({glm::length(glm::vec3(model_matrix[0])), glm::length(glm::vec3(model_matrix[1])),
+                                      glm::length(glm::vec3(model_matrix[2]))});
 
-        // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+        for (size_t i = 0; i < meshes.size(); i++)
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
+            const Mesh& mesh = meshes[i];
+            if (mesh.lod_count < 2)
+                continue;
+            unsigned int lod = std::min<unsigned int>(lod_hint_[i], mesh.lod_count - 1);
+            float distance = 1.0f;
+            if (perspective)
             {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
+                glm::vec3 center = glm::vec3(model_matrix * glm::vec4(mesh.bounds.sphere.center, 1.0f));
+                distance = glm::length(eye - center) - mesh.bounds.sphere.radius*scale;
+                if (distance <= 0.0f)  // inside the bounds
+                    lod = 0;
             }
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            if (distance > 0.0f)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                auto pixels = [&](unsigned int level) { return mesh.lods[level].error*scale*pixels_per_unit/distance; };
+                while (lod + 1 < mesh.lod_count && pixels(lod + 1) <= LOD_HYSTERESIS*lod_pixel_error_)
+                    lod++;
+                while (lod > 0 && pixels(lod) > lod_pixel_error_)
+                    lod--;
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
+            lod_hint_[i] = (unsigned char)lod;
+            selection[i] = (unsigned char)lod;
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+    }
+
+    // Largest error on screen allowed by the levels of detail [px] (0 keeps every mesh at full detail)
+    static void set_lod_pixel_error(float pixels)
+    {
+        lod_pixel_error_ = pixels;
+    }
+
+    // Directory of the preprocessed mesh cache (empty disables it, Assimp then runs on every load)
+    static void set_mesh_cache_directory(const std::string& directory)
+    {
+        mesh_cache_directory_ = directory;
+    }
+    static unsigned long mesh_cache_hits()
+    {
+        return mesh_cache_hits_;
+    }
+    static unsigned long mesh_cache_misses()
+    {
+        return mesh_cache_misses_;
+    }
+
+private:
+    vector<unsigned char> lod_hint_;  // levels of the last select_lods, where the hysteresis starts from
+    MeshSelection selection_;         // scratch of submit, copied to the queue
+    GLuint instance_vbo_ = 0;  // model matrices of DrawInstanced
+    size_t instance_capacity_ = 0;
+
+    static inline std::string mesh_cache_directory_;
+    static inline unsigned long mesh_cache_hits_ = 0;
+    static inline unsigned long mesh_cache_misses_ = 0;
+    static inline float lod_pixel_error_ = 1.0f;
+    static constexpr float LOD_HYSTERESIS = 0.75f;
+
+    // draws the meshes at the levels of selection (all at full detail without one), count instances
+    // of each when count is not 0
+    void drawMeshes(Shader &shader, const unsigned char* selection, GLsizei count)
+    {
+        gl_state().disable(GL_BLEND);
+        gl_state().disable(GL_CULL_FACE);
+        const Mesh* previous = nullptr;
+        for (size_t i = 0; i < meshes.size(); i++)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);        
+            const Mesh& mesh = meshes[i];
+            const unsigned int level = selection ? selection[i] : 0;
+            if (level == MESH_CULLED)
+                continue;
+            if (previous == nullptr || mesh.arena != previous->arena)
+                gl_state().bind_vertex_array(arenas[mesh.arena].VAO);
+            if (previous == nullptr || mesh.material != previous->material)
+                materials[mesh.material].bind(shader);
+            const MeshLod& lod = mesh.lods[std::min(level, mesh.lod_count - 1)];
+            void* first = (void*)(size_t(mesh.first_index + lod.first_index)*sizeof(unsigned int));
+            if (count == 0)
+                glDrawElementsBaseVertex(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT, first, mesh.base_vertex);
+            else
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT, first, count, mesh.base_vertex);
+            gl_state().count_draw();
+            previous = &mesh;
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
-
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
-    }
-
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    }
+
+    // loads a model from the mesh cache, or with ASSIMP when the cache is missing or stale, and stores the resulting meshes in the meshes vector.
+    void loadModel(string const &path)
     {
-        vector<Texture> textures;
-        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        PROFILE_SCOPE("Model::loadModel");
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        const char* source = "mesh cache";
+        if (!loadCachedModel(path))
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            source = "assimp";
+            std::vector<ImportedMesh> imported;
+            if (!import_model(path, imported))
+                return;
+            vector<MeshSource> sources;
+            for (ImportedMesh const& mesh: imported)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
+                sources.push_back({{mesh.vertex_data.data(), mesh.vertex_count, mesh.indices.data(), (unsigned int)mesh.indices.size()},
+                                   mesh.format, mesh.textures, mesh.lods, mesh.bounds});
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+            buildMeshes(sources);
+            if (!mesh_cache_directory_.empty())
+            {
+                std::uint64_t key = mesh_cache_key(path);
+                if (key != 0)
+                    write_mesh_cache(mesh_cache_path(mesh_cache_directory_, path), key, imported);
             }
         }
-        return textures;
+
+        size_t lod_triangles[MESH_LOD_MAX] = {};
+        for (Mesh const& mesh: meshes) {
+            for (unsigned int level = 0; level < MESH_LOD_MAX; level++)
+                lod_triangles[level] += mesh.lods[std::min(level, mesh.lod_count - 1)].index_count/3;
+        }
+        size_t vertex_count = 0, unpacked_bytes = 0, packed_bytes = 0;
+        for (MeshArena const& arena: arenas) {
+            vertex_count += arena.vertex_count();
+            unpacked_bytes += arena.unpacked_vertex_bytes();
+            packed_bytes += arena.packed_vertex_bytes();
+        }
+        cout << "Model " << path << " (" << source << "): " << meshes.size() << " meshes in " << arenas.size() << " arenas with "
+             << materials.size() << " materials, " << vertex_count << " vertices, vertex data "
+             << unpacked_bytes/1024.0 << " KiB -> " << packed_bytes/1024.0 << " KiB, triangles per level of detail "
+             << lod_triangles[0] << " / " << lod_triangles[1] << " / " << lod_triangles[2] << " / " << lod_triangles[3] << endl;
     }
-};
 
+    // uploads the meshes straight from the mapped cache file, returns false on a miss
+    bool loadCachedModel(string const &path)
+    {
+        if (mesh_cache_directory_.empty())
+            return false;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-    QOpenGLFunctions_3_3_Core *functions = new QOpenGLFunctions_3_3_Core;
-    functions->initializeOpenGLFunctions();
-    
-    string filename = string(path);
-    filename = directory + '/' + filename;
+        MeshCacheFile cache;
+        std::uint64_t key = mesh_cache_key(path);
+        if (key == 0 || !cache.open(mesh_cache_path(mesh_cache_directory_, path), key))
+        {
+            mesh_cache_misses_++;
+            return false;
+        }
+        vector<MeshSource> sources;
+        for (size_t i = 0; i < cache.mesh_count(); i++)
+        {
+            const MeshCacheRecord& record = cache.record(i);
+            sources.push_back({{cache.vertex_data(i), record.vertex_count, cache.index_data(i), record.index_count},
+                               cache.format(i), cache.textures(i), cache.lods(i), cache.bounds(i)});
+        }
+        buildMeshes(sources);  // uploads before the file is unmapped
+        mesh_cache_hits_++;
+        return true;
+    }
 
-    unsigned int textureID;
-    functions->glGenTextures(1, &textureID);
+    // a mesh as loaded, before it is placed in an arena
+    struct MeshSource {
+        MeshData data;
+        VertexFormat format;
+        vector<TextureReference> textures;
+        vector<MeshLod> lods;  // finest first
+        Bounds bounds;
+    };
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // uploads the meshes into one arena per vertex format and shares materials between them
+    void buildMeshes(const vector<MeshSource>& sources)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        vector<VertexFormat> formats;
+        vector<vector<MeshData>> arena_data;
+        vector<Mesh> placed(sources.size());
+        vector<size_t> slot(sources.size());  // position of each source in its arena
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            size_t arena = std::find(formats.begin(), formats.end(), sources[i].format) - formats.begin();
+            if (arena == formats.size())
+            {
+                formats.push_back(sources[i].format);
+                arena_data.emplace_back();
+            }
+            slot[i] = arena_data[arena].size();
+            arena_data[arena].push_back(sources[i].data);
 
-        functions->glBindTexture(GL_TEXTURE_2D, textureID);
-        functions->glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        functions->glGenerateMipmap(GL_TEXTURE_2D);
+            Material material{loadTextures(sources[i].textures)};
+            size_t material_index = std::find(materials.begin(), materials.end(), material) - materials.begin();
+            if (material_index == materials.size())
+                materials.push_back(material);
 
-        functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        functions->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            placed[i].arena = (unsigned int)arena;
+            placed[i].material = (unsigned int)material_index;
+            placed[i].vertex_count = sources[i].data.vertex_count;
+            placed[i].lod_count = (unsigned int)std::min<size_t>(sources[i].lods.size(), MESH_LOD_MAX);
+            std::copy(sources[i].lods.begin(), sources[i].lods.begin() + placed[i].lod_count, placed[i].lods);
+            placed[i].bounds = sources[i].bounds;
+        }
 
-        stbi_image_free(data);
+        for (size_t arena = 0; arena < formats.size(); arena++)
+            arenas.emplace_back(formats[arena], arena_data[arena]);
+        for (size_t i = 0; i < placed.size(); i++)
+        {
+            placed[i].first_index = arenas[placed[i].arena].first_index(slot[i]);
+            placed[i].base_vertex = arenas[placed[i].arena].base_vertex(slot[i]);
+        }
+
+        // draw order: fewest vertex array and texture switches
+        std::stable_sort(placed.begin(), placed.end(), [](const Mesh& a, const Mesh& b) {
+            return a.arena != b.arena ? a.arena < b.arena : a.material < b.material;
+        });
+        meshes = placed;
     }
-    else
+
+    // gets the referenced textures from the process-wide cache, which decodes each file once (in the background).
+    // the required info is returned as Texture structs.
+    vector<Texture> loadTextures(const vector<TextureReference>& references)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        vector<Texture> textures;
+        for (TextureReference const& reference: references)
+        {
+            Texture texture;
+            texture.id = TextureCache::instance().acquire(directory + '/' + reference.path);  // flipped to match aiProcess_FlipUVs
+            texture.type = reference.type;
+            texture.path = reference.path;
+            textures.push_back(texture);
+            if (std::none_of(textures_loaded.begin(), textures_loaded.end(), [&texture](const Texture& loaded) { return loaded.id == texture.id; }))
+                textures_loaded.push_back(texture);
+        }
+        return textures;
     }
+};
+
 
-    delete functions;
-    
-    return textureID;
-}
 #endif
@@ -0,0 +1,254 @@
+#ifndef MODEL_IMPORT_H
+#define MODEL_IMPORT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/packing.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <general_inc/mesh.h>
+#include <general_inc/mesh_optimize.h>
+#include <general_inc/mesh_simplify.h>
+#include <general_inc/profiler.h>
+#include <general_inc/thread_pool.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Post processing applied to every imported model (part of the mesh cache key)
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// Triangle ratios of the simplified levels of detail (at most MESH_LOD_MAX - 1)
+const std::vector<float> MESH_LOD_RATIOS = {0.5f, 0.25f, 0.1f};
+const float MESH_LOD_MIN_REDUCTION = 0.8f;  // a level is kept if it has at most this ratio of the previous level's triangles
+
+/// Texture file referenced by a mesh's material, path relative to the model's directory
+struct TextureReference {
+    std::string type;  // sampler name prefix, eg. texture_diffuse
+    std::string path;
+};
+
+/// A mesh ready for upload: vertices already packed in format (see VertexFormat)
+struct ImportedMesh {
+    VertexFormat format;
+    unsigned int vertex_count = 0;
+    std::vector<unsigned char> vertex_data;
+    std::vector<unsigned int> indices;  // every level of detail, one after the other
+    std::vector<MeshLod> lods;          // ranges of indices, finest first
+    Bounds bounds;
+    std::vector<TextureReference> textures;
+};
+
+// Interleaves the attributes of format
+std::vector<unsigned char> pack_vertices(const std::vector<Vertex>& vertices, const VertexFormat& format)
+{
+    auto unit_or_zero = [](const glm::vec3& v) {
+        float length = glm::length(v);
+        return length > 0.0f ? v/length : glm::vec3(0.0f);
+    };
+
+    const GLsizei stride = format.stride();
+    std::vector<unsigned char> packed(vertices.size()*stride);
+    for (std::size_t i = 0; i < vertices.size(); i++) {
+        const Vertex& vertex = vertices[i];
+        unsigned char* out = &packed[i*stride];
+        std::memcpy(out, &vertex.Position, 3*sizeof(float));
+        if (format.normals) {
+            std::uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(unit_or_zero(vertex.Normal), 0.0f));
+            std::memcpy(out + format.normal_offset(), &normal, sizeof(normal));
+        }
+        if (format.texcoords && format.half_texcoords) {
+            std::uint32_t texcoords = glm::packHalf2x16(vertex.TexCoords);
+            std::memcpy(out + format.texcoords_offset(), &texcoords, sizeof(texcoords));
+        }
+        else if (format.texcoords) {
+            std::memcpy(out + format.texcoords_offset(), &vertex.TexCoords, 2*sizeof(float));
+        }
+        if (format.tangents) {
+            float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            std::uint32_t tangent = glm::packSnorm3x10_1x2(glm::vec4(unit_or_zero(vertex.Tangent), handedness));
+            std::memcpy(out + format.tangent_offset(), &tangent, sizeof(tangent));
+        }
+        if (format.bones) {
+            std::uint16_t ids[MAX_BONE_INFLUENCE];
+            glm::vec4 weights(0.0f);
+            for (int j = 0; j < MAX_BONE_INFLUENCE; j++) {
+                ids[j] = static_cast<std::uint16_t>(vertex.m_BoneIDs[j]);
+                weights[j] = vertex.m_Weights[j];
+            }
+            std::uint32_t packed_weights = glm::packUnorm4x8(weights);
+            std::memcpy(out + format.bones_offset(), ids, sizeof(ids));
+            std::memcpy(out + format.weights_offset(), &packed_weights, sizeof(packed_weights));
+        }
+    }
+    return packed;
+}
+
+// Texture files of one type in a material
+void import_material_textures(const aiMaterial* material, aiTextureType type, const std::string& type_name,
+                              std::vector<TextureReference>& textures)
+{
+    for (unsigned int i = 0; i < material->GetTextureCount(type); i++) {
+        aiString path;
+        material->GetTexture(type, i, &path);
+        textures.push_back({type_name, path.C_Str()});
+    }
+}
+
+ImportedMesh import_mesh(const aiMesh* mesh, const aiScene* scene)
+{
+    std::vector<Vertex> vertices(mesh->mNumVertices, Vertex{});
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+        Vertex& vertex = vertices[i];
+        vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        if (mesh->HasNormals()) {
+            vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        }
+        // a vertex can contain up to 8 different texture coordinates, we only use the first set
+        if (mesh->mTextureCoords[0]) {
+            vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+        }
+        if (mesh->HasTangentsAndBitangents()) {
+            vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+            vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+        }
+    }
+
+    // bone influences, keeping the MAX_BONE_INFLUENCE strongest per vertex
+    for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+        const aiBone* bone = mesh->mBones[b];
+        for (unsigned int w = 0; w < bone->mNumWeights; w++) {
+            Vertex& vertex = vertices[bone->mWeights[w].mVertexId];
+            int weakest = 0;
+            for (int j = 1; j < MAX_BONE_INFLUENCE; j++) {
+                if (vertex.m_Weights[j] < vertex.m_Weights[weakest]) { weakest = j; }
+            }
+            if (bone->mWeights[w].mWeight > vertex.m_Weights[weakest]) {
+                vertex.m_BoneIDs[weakest] = b;
+                vertex.m_Weights[weakest] = bone->mWeights[w].mWeight;
+            }
+        }
+    }
+    if (mesh->HasBones()) {
+        for (Vertex& vertex: vertices) {
+            float total = 0.0f;
+            for (int j = 0; j < MAX_BONE_INFLUENCE; j++) { total += vertex.m_Weights[j]; }
+            for (int j = 0; total > 0.0f && j < MAX_BONE_INFLUENCE; j++) { vertex.m_Weights[j] /= total; }
+        }
+    }
+
+    ImportedMesh imported;
+    // faces are triangles after aiProcess_Triangulate
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        const aiFace& face = mesh->mFaces[i];
+        imported.indices.insert(imported.indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+    }
+
+    // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+    // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+    const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+    import_material_textures(material, aiTextureType_DIFFUSE, "texture_diffuse", imported.textures);
+    import_material_textures(material, aiTextureType_SPECULAR, "texture_specular", imported.textures);
+    import_material_textures(material, aiTextureType_HEIGHT, "texture_normal", imported.textures);
+    import_material_textures(material, aiTextureType_AMBIENT, "texture_height", imported.textures);
+
+    // upload only the attributes this mesh has (tangents only serve normal mapping)
+    bool normal_mapped = material->GetTextureCount(aiTextureType_HEIGHT) > 0 || material->GetTextureCount(aiTextureType_AMBIENT) > 0;
+    imported.format.normals = mesh->HasNormals();
+    imported.format.texcoords = mesh->mTextureCoords[0] != nullptr;
+    imported.format.tangents = mesh->HasTangentsAndBitangents() && normal_mapped;
+    imported.format.bones = mesh->HasBones();
+    for (Vertex const& vertex: vertices) {
+        if (glm::abs(vertex.TexCoords.x) > HALF_TEXCOORDS_MAX || glm::abs(vertex.TexCoords.y) > HALF_TEXCOORDS_MAX) {
+            imported.format.half_texcoords = false;
+            break;
+        }
+    }
+
+    imported.vertex_count = mesh->mNumVertices;
+    imported.vertex_data = pack_vertices(vertices, imported.format);
+    return imported;
+}
+
+// Appends the simplified levels of detail to the mesh's indices, each ordered for the vertex cache.
+// Levels that hardly simplify (locked borders and seams) are left out.
+void build_lods(ImportedMesh& mesh)
+{
+    mesh.lods.assign(1, MeshLod{0, (unsigned int)mesh.indices.size(), 0.0f});
+    std::vector<SimplifiedMesh> levels = simplify_lods(mesh.indices, mesh.vertex_data, mesh.vertex_count, mesh.format.stride(), MESH_LOD_RATIOS);
+    for (SimplifiedMesh& level: levels) {
+        if (level.indices.empty() || level.indices.size() > MESH_LOD_MIN_REDUCTION*mesh.lods.back().index_count) { continue; }
+        optimize_vertex_cache(level.indices, mesh.vertex_count);
+        mesh.lods.push_back({(unsigned int)mesh.indices.size(), (unsigned int)level.indices.size(), level.error});
+        mesh.indices.insert(mesh.indices.end(), level.indices.begin(), level.indices.end());
+    }
+}
+
+// Box and sphere of the mesh's vertices, for culling and picking the levels of detail
+void compute_bounds(ImportedMesh& mesh)
+{
+    const std::size_t stride = mesh.format.stride();
+    std::vector<glm::vec3> positions(mesh.vertex_count);
+    for (unsigned int v = 0; v < mesh.vertex_count; v++) {
+        std::memcpy(&positions[v], &mesh.vertex_data[v*stride], sizeof(glm::vec3));
+    }
+    mesh.bounds = bounds_of(positions);
+}
+
+// Meshes of a node and its children, in depth first order
+void import_node(const aiNode* node, const aiScene* scene, std::vector<ImportedMesh>& meshes)
+{
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        meshes.push_back(import_mesh(scene->mMeshes[node->mMeshes[i]], scene));
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        import_node(node->mChildren[i], scene, meshes);
+    }
+}
+
+/// Reads a model file with Assimp (no OpenGL needed), returns false if it can't be imported
+bool import_model(const std::string& path, std::vector<ImportedMesh>& meshes)
+{
+    PROFILE_SCOPE("import_model");
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    meshes.clear();
+    import_node(scene->mRootNode, scene, meshes);
+
+    // Weld and reorder every mesh for the vertex caches and overdraw (see mesh_optimize.h), then simplify
+    // its levels of detail, one mesh per worker. The packed vertices are welded so the importer doesn't
+    // need aiProcess_JoinIdenticalVertices.
+    std::vector<std::future<MeshOptimization>> optimizations;
+    for (ImportedMesh& mesh: meshes) {
+        ImportedMesh* target = &mesh;
+        optimizations.push_back(worker_pool().submit([target]() {
+            MeshOptimization result = optimize_mesh(target->vertex_data, target->vertex_count, target->format.stride(), target->indices);
+            build_lods(*target);
+            compute_bounds(*target);
+            return result;
+        }));
+    }
+    MeshOptimization total;
+    for (auto& optimization: optimizations) {
+        MeshOptimization result = optimization.get();
+        total.before += result.before;
+        total.after += result.after;
+    }
+    std::cout << "Mesh optimizer: " << path << ": " << total.before.vertices << " -> " << total.after.vertices << " vertices, ACMR "
+              << total.before.acmr() << " -> " << total.after.acmr() << ", ATVR " << total.before.atvr() << " -> " << total.after.atvr()
+              << " (" << VERTEX_CACHE_ANALYSIS_SIZE << " entry FIFO)" << std::endl;
+    return true;
+}
+
+#endif
@@ -10,6 +10,8 @@ namespace fs = boost::filesystem;
 namespace fs = std::experimental::filesystem;
 #endif
 
+#include <string>
+
 fs::path ROOT_PROJECT_DIRECTORY = fs::current_path();
 fs::path SHADERS_PATH = ROOT_PROJECT_DIRECTORY / "shaders";  
 
@@ -21,6 +23,7 @@ fs::path ASSETS_PATH = RESOURCES_PATH / "objects";
 
 // Model loading
 fs::path MODEL_VS = SHADERS_PATH / "model_loading.vs";
+fs::path MODEL_INSTANCED_VS = SHADERS_PATH / "model_loading_instanced.vs";
 fs::path MODEL_FS = SHADERS_PATH / "model_loading.fs";
 
 // Cube map
@@ -49,6 +52,10 @@ fs::path POLYGON_FS = SHADERS_PATH / "polygon.fs";
 fs::path TEXT_VS = SHADERS_PATH / "text.vs";
 fs::path TEXT_FS = SHADERS_PATH / "text.fs";
 
+// Labels
+fs::path LABEL_VS = SHADERS_PATH / "label.vs";
+fs::path LABEL_FS = SHADERS_PATH / "label.fs";
+
 // Ellipsoid
 fs::path ELLIPSOID_VS = SHADERS_PATH / "ellipsoid.vs";
 fs::path ELLIPSOID_FS = SHADERS_PATH / "ellipsoid.fs";
@@ -68,4 +75,21 @@ fs::path CUBEMAP_PATH = RESOURCES_PATH / "cubemaps" / "universe";
 // Text font
 fs::path TEXT_FONT_PATH = RESOURCES_PATH / "fonts" / "Antonio-Bold.ttf";
 
+// Caches written at runtime
+fs::path CACHE_PATH = ROOT_PROJECT_DIRECTORY / "cache";
+fs::path SHADER_CACHE_PATH = CACHE_PATH / "shaders";
+fs::path MESH_CACHE_PATH = CACHE_PATH / "meshes";
+fs::path FONT_CACHE_PATH = CACHE_PATH / "fonts";
+
+// Unique spelling of a file's path, used as cache key (the path as given if it doesn't exist)
+std::string canonical_path(const std::string& path)
+{
+    try {
+        return fs::canonical(fs::path(path)).string();
+    }
+    catch (fs::filesystem_error&) {
+        return path;
+    }
+}
+
 #endif
\ No newline at end of file
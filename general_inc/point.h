@@ -1,6 +1,8 @@
 
 #include <Eigen/Core>
 
+#include <memory>
+#include <utility>
 #include <vector>
 #include <string>
 #include <stdexcept>
@@ -8,7 +10,10 @@
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/profiler.h>
 
 #include <general_inc/text.h>
 #include <general_inc/billboard.h>
@@ -35,25 +40,24 @@ public:
     
     Point() = delete; // need to at least give some coordinates
 
+    // Picking reads the points' coordinates and descriptions, Retention::DROP_AFTER_UPLOAD frees
+    // them and turns picking off. Pass the points with std::move when the caller no longer needs them.
     Point(std::vector<GeoPoint> geopoints, float size, 
          Symbol symbol = Symbol::SQUARE,  bool fixed_size = false,
-         glm::vec4 color = glm::vec4(0.0, 1.0, 0.0, 1.0))
+         glm::vec4 color = glm::vec4(0.0, 1.0, 0.0, 1.0), Retention retention = Retention::KEEP_FOR_PICKING)
     {
-        geopoints_ = geopoints;
+        geopoints_ = std::move(geopoints);
         size_ = size;
         symbol_ = symbol;
         color_ = color;
         fixed_size_ = fixed_size;
         
-        // Point shader
-        const char* vertex_shader_path = POINT_VS.string().c_str();
-        const char* fragment_shader_path = POINT_FS.string().c_str();
-        const char* geometry_shader_path = POINT_GS.string().c_str();
-        m_point_shader = new Shader(vertex_shader_path, fragment_shader_path, geometry_shader_path);
+        // Point shader (shared between all point layers)
+        m_point_shader = get_shader(POINT_VS, POINT_FS, POINT_GS);
 
         VertexP vertex;
 
-        for (auto const& geopoint : geopoints) {// access by const reference  
+        for (auto const& geopoint : geopoints_) {// access by const reference  
             glm::vec3 vector; 
             // positions 
             vector.x = geopoint.coordinate[0];
@@ -67,11 +71,11 @@ public:
         // Billboard rectangle
 
         // Billboard text (set ramdon initial positions/text)
-        m_text = new Text3D("hecls\noshfosei\ndfca", 0.0, 0.0, 0.0, 1.0f/2000.0f, 
-                            {1, 0, 0}, 0.0, 0.0);//1.0f/600.0f); 
+        m_text = std::make_unique<Text3D>("hecls\noshfosei\ndfca", 0.0, 0.0, 0.0, 1.0f/2000.0f, 
+                                          glm::vec3(1, 0, 0), 0.0, 0.0);//1.0f/600.0f); 
 
-        m_billboard = new BillboardPolygon(geopoints.back().coordinate, m_text->get_text_screen_size().first, 
-                                           m_text->get_text_screen_size().second, 0, 0, {1.0, 1.0, 1.0, 0.5});
+        m_billboard = std::make_unique<BillboardPolygon>(geopoints_.back().coordinate, m_text->get_text_screen_size().first, 
+                                                         m_text->get_text_screen_size().second, 0, 0, glm::vec4(1.0, 1.0, 1.0, 0.5));
         // m_billboard = new BillboardPolygon(Eigen::Vector3f({0, 0, 0}), 0.4, 
         //                                    0.5, 0, 0, {1.0, 1.0, 1.0, 0.5});
 
@@ -79,22 +83,30 @@ public:
  
         // Setup opengl states
         setup(); 
-    }
 
-    ~Point() {
-        delete m_point_shader;
+        vertex_count_ = vertices_.size();
+        if (retention != Retention::KEEP_ALL) {
+            release(vertices_);  // picking uses the coordinates of geopoints_
+        }
+        if (retention == Retention::DROP_AFTER_UPLOAD) {
+            release(geopoints_);
+        }
     }
 
     void setup()
     {
+        bounds_ = vertex_bounds(vertices_);
+        center_ = bounds_.box.center();
+        if (!fixed_size_) { bounds_.pad(size_); }  // symbols of fixed size are in pixels, they may stick out a little
+
         // Create the buffers and array:
         glGenVertexArrays(1, &vao_);
         glGenBuffers(1, &vbo_);
 
-        glBindVertexArray(vao_);  
+        gl_state().bind_vertex_array(vao_);  
 
         // load data into buffers
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(VertexP), &vertices_[0], GL_STATIC_DRAW);  
 
         // set the vertex attribute pointers:
@@ -108,6 +120,7 @@ public:
     // Args:
     // ray_ndc: incoming ray in normalised device coordinates
     bool test_ray_tracing(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f), glm::vec3 ray_ndc = glm::vec3(0.0f)) {
+        PROFILE_SCOPE("Point::test_ray_tracing");
         
         // Test ray tracing intersection 
         draw_description_ = false;
@@ -138,10 +151,10 @@ public:
 
             // std::cout << ray_clip.x << " " << ray_clip.y << " " <<ray_clip.z << " " << ray_clip.w << std::endl;
 
-            for (std::size_t i = 0; i < vertices_.size(); i++)
+            for (std::size_t i = 0; i < geopoints_.size(); i++)
             {
-                VertexP vertex = vertices_[i];
-                glm::vec4 vertex_center_clip = projection_matrix * view_matrix * glm::vec4(vertex.Position, 1.0);
+                const Eigen::Vector3f& coordinate = geopoints_[i].coordinate;
+                glm::vec4 vertex_center_clip = projection_matrix * view_matrix * glm::vec4(coordinate.x(), coordinate.y(), coordinate.z(), 1.0);
                 glm::vec4 vertex_center_clip_norm = glm::normalize(vertex_center_clip);
                 glm::vec4 vertex_center_ndc = vertex_center_clip_norm/vertex_center_clip_norm.w;
 
@@ -161,74 +174,110 @@ public:
 
         if (draw_description_)
         {
-            GeoPoint geopoint = geopoints_[description_index];
+            const GeoPoint& geopoint = geopoints_[description_index];
             m_text->change_text(geopoint.description, geopoint.coordinate.x(), geopoint.coordinate.y(), geopoint.coordinate.z());
             m_billboard->change_billboard(geopoint.coordinate, m_text->get_text_screen_size().first, m_text->get_text_screen_size().second);   
+            description_position_ = glm::vec3(geopoint.coordinate.x(), geopoint.coordinate.y(), geopoint.coordinate.z());
         }
 
         return false;
     }
     
-    void draw(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f))
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix)
     {
-        m_point_shader->use();  // Bind shader
-
-        // Set the uniforms:
-        m_point_shader->setVec4("ourColor", color_); // Set uniform
-        m_point_shader->setMat4("view", view_matrix);
-        m_point_shader->setMat4("projection", projection_matrix);
-        m_point_shader->setBool("fixed_size", fixed_size_);
-        m_point_shader->setFloat("size", size_);
-
-        switch (symbol_) {
-            case Symbol::SQUARE: {
-                m_point_shader->setBool("square", true);
-                break;
-            }
-            case Symbol::CIRCLE: {
-                m_point_shader->setBool("circle", true);
-                break;
-            }
-            case Symbol::TRIANGLE: { 
-                m_point_shader->setBool("triangle", true);
-                break;
-            }
-            default: { 
-                m_point_shader->setBool("triangle", true);
-                break; 
-            }  // draw a triangle
-        }
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw();
+    }
 
-        // Draw line
-        glBindVertexArray(vao_);
-        glDrawArrays(GL_POINTS, 0, vertices_.size()); 
-        glBindVertexArray(0);  // Unbind vao
+    // Draw using the camera matrices of the shared CameraBlock uniform buffer
+    void draw()
+    {
+        draw_points();
 
         // Draw text
-        // m_billboard->draw(view_matrix, projection_matrix);
         
         if (draw_description_) 
         {
-            m_billboard->draw(view_matrix, projection_matrix);
-            m_text->draw(view_matrix, projection_matrix, true);
+            draw_description();
         }
     }
 
+    // Queue the points with the opaque layers, sorted by program and distance to the camera. The
+    // description of the selected point is blended: it goes with the transparent items, after the
+    // skybox, or the corners of its glyph quads would hide the sky behind them.
+    void submit(RenderQueue& queue)
+    {
+        if (queue.visible(bounds_))
+            queue.submit(RenderPass::OPAQUE, "points", m_point_shader->ID, 0, center_, [this]() { draw_points(); });
+        if (draw_description_)  // the description can be anywhere on screen
+            queue.submit(RenderPass::TRANSPARENT, "point description", 0, 0, description_position_, [this]() { draw_description(); });
+    }
+
+    // Model space box and sphere of the symbols, tested against the view frustum before submitting
+    const Bounds& bounds() const
+    {
+        return bounds_;
+    }
+
+    // The description text and its billboard are not counted
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(vertices_) + heap_bytes(geopoints_);
+        for (auto const& geopoint: geopoints_) { usage.cpu_bytes += geopoint.description.capacity(); }
+        usage.gpu_bytes = vertex_count_*sizeof(VertexP);
+        return usage;
+    }
+
 private:
+    void draw_points()
+    {
+        m_point_shader->use();  // Bind shader
+
+        // Set the uniforms:
+        m_point_shader->setVec4("ourColor", color_); // Set uniform
+        m_point_shader->setBool("fixed_size", fixed_size_);
+        m_point_shader->setFloat("size", size_);
+
+        // The program is shared with other point layers so every symbol flag has to be set
+        // (anything that is neither a circle nor a square is drawn as a triangle)
+        m_point_shader->setBool("square", symbol_ == Symbol::SQUARE);
+        m_point_shader->setBool("circle", symbol_ == Symbol::CIRCLE);
+
+        // Draw points
+        gl_state().disable(GL_CULL_FACE);
+        gl_state().disable(GL_BLEND);
+        gl_state().bind_vertex_array(vao_);
+        glDrawArrays(GL_POINTS, 0, vertex_count_); 
+        gl_state().count_draw();
+    }
+
+    // Billboard then text, both blended over what is already drawn
+    void draw_description()
+    {
+        m_billboard->draw();
+        m_text->draw(true);
+    }
+
     glm::vec4 color_ = glm::vec4(1.0, 0.0, 0.0, 1.0);
     float size_ = 5;
     bool fixed_size_ = false;
     Symbol symbol_ = Symbol::SQUARE;
-    std::vector<VertexP> vertices_;
+    std::vector<VertexP> vertices_;  // empty after setup() unless Retention::KEEP_ALL
+    std::size_t vertex_count_ = 0;
+    Bounds bounds_;
+    glm::vec3 center_ = glm::vec3(0.0f);  // sort position in the render queue
     unsigned int vao_, vbo_;
     
-    Shader* m_point_shader;
+    std::shared_ptr<Shader> m_point_shader;
 
     // Billboard
-    Text3D* m_text;
-    BillboardPolygon* m_billboard;
+    std::unique_ptr<Text3D> m_text;
+    std::unique_ptr<BillboardPolygon> m_billboard;
 
-    std::vector<GeoPoint> geopoints_;
+    std::vector<GeoPoint> geopoints_;  // empty after setup() for Retention::DROP_AFTER_UPLOAD
     bool draw_description_ = false;
     std::size_t description_index = 0;
+    glm::vec3 description_position_ = glm::vec3(0.0f);  // where the description sorts among the transparent items
 };
\ No newline at end of file
@@ -1,13 +1,17 @@
 #include <glm/glm.hpp>
 #include <Eigen/Core>
 
+#include <memory>
+#include <utility>
 #include <vector>
 #include <stdexcept>
 
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
 #include <general_inc/line.h>
 #include <general_inc/utilities.h> // colors
 
@@ -27,25 +31,25 @@ public:
     
     Polygon3D() = delete; // need to at least give some coordinates
 
+    // Pass the polygons with std::move when the caller no longer needs them, they end up in the
+    // outline Line (which keeps them only for Retention::KEEP_ALL)
     Polygon3D(std::vector<std::vector<Eigen::Vector3f>> polygons, Color fill_color = Color::GREEN,
-            float linewidth = DEFAULT_LINE_WIDTH, Color linecolor = Color::BLACK, bool is_concave = false)
+            float linewidth = DEFAULT_LINE_WIDTH, Color linecolor = Color::BLACK, bool is_concave = false,
+            Retention retention = Retention::DROP_AFTER_UPLOAD)
     {
         linewidth_ = linewidth;
         fill_color_ = fill_color;
         linecolor_ = linecolor;
 
-        // Polygon3D shader
-        const char* polygon_vertex_shader_path = POLYGON_VS.string().c_str();
-        const char* polygon_fragment_shader_path = POLYGON_FS.string().c_str();
-        m_polygon_shader = new Shader(polygon_vertex_shader_path, polygon_fragment_shader_path);
+        // Polygon3D shader (shared between all polygons)
+        m_polygon_shader = get_shader(POLYGON_VS, POLYGON_FS);
 
         // // Create the outline lines
         // m_outline_lines = new Line(the_coordinates, linewidth); 
 
         SimpleVertex vertex;
         
-        unsigned int element_start_index = 0;
-        unsigned int polygon_size = 0;
+        GLint element_start_index = 0;
 
         // if (is_concave) { // Triangulate polygons
         //     for (const std::vector<Eigen::Vector3f>& original_polygon: polygons) {
@@ -69,15 +73,15 @@ public:
         //     }
         // }
 
-        polygons_ = polygons;
         polygons_count_ = polygons.size();
+        elements_start_indexes_.reserve(polygons_count_);
+        element_vertex_count_.reserve(polygons_count_);
 
         for(std::size_t i = 0; i < polygons_count_; ++i) {
 
             const std::vector<Eigen::Vector3f>& polygon = polygons[i];
-            polygon_size = polygon.size();
-            element_vertex_count_[i] = (GLsizei)polygon_size;
-            elements_start_indexes_[i] = (GLuint)element_start_index;
+            element_vertex_count_.push_back((GLsizei)polygon.size());
+            elements_start_indexes_.push_back(element_start_index);
 
             for (const Eigen::Vector3f& coordinate : polygon) {
                 glm::vec3 vector; 
@@ -90,33 +94,36 @@ public:
                 vertices_.push_back(vertex);
             }
 
-            element_start_index += polygon_size;
+            element_start_index += (GLint)polygon.size();
         }
 
         // Create the polygons outline lines
-        outline_lines_ptr = new Line(polygons, linewidth_, linecolor_); 
+        outline_lines_ptr = std::make_unique<Line>(std::move(polygons), linewidth_, linecolor_, retention); 
 
         initializeOpenGLFunctions();   // Initialise current context  (required)
  
         // Setup opengl states
         setup(); 
-    }
 
-    ~Polygon3D() {
-        // delete m_outline_lines;
-        delete m_polygon_shader;
+        vertex_count_ = vertices_.size();
+        if (retention != Retention::KEEP_ALL) {
+            release(vertices_);
+        }
     }
 
     void setup()
     {
+        bounds_ = vertex_bounds(vertices_);
+        center_ = bounds_.box.center();
+
         // Create the buffers and array:
         glGenVertexArrays(1, &vao_);
         glGenBuffers(1, &vbo_);
 
-        glBindVertexArray(vao_);  
+        gl_state().bind_vertex_array(vao_);  
 
         // load data into buffers
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
         glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(SimpleVertex), &vertices_[0], GL_STATIC_DRAW);  
 
         // set the vertex attribute pointers:
@@ -125,38 +132,72 @@ public:
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SimpleVertex), (void*)0);
     }
 
-    void draw(glm::mat4 view_matrix = glm::mat4(1.0f), glm::mat4 projection_matrix = glm::mat4(1.0f))
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
+    void draw(glm::mat4 view_matrix, glm::mat4 projection_matrix)
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw();
+    }
+
+    // Draw using the camera matrices of the shared CameraBlock uniform buffer
+    void draw()
     {
         m_polygon_shader->use();  // Bind shader
 
         // Set the uniforms:
         glm::vec4 ourcolor = get_color(fill_color_);  // get the color
         m_polygon_shader->setVec4("ourColor", ourcolor); // Set uniform
-        m_polygon_shader->setMat4("view", view_matrix);
-        m_polygon_shader->setMat4("projection", projection_matrix);
     
         // Draw polygons
-        glEnable(GL_MULTISAMPLE);  // Antialiasing
-        glBindVertexArray(vao_);
+        gl_state().enable(GL_MULTISAMPLE);  // Antialiasing
+        gl_state().disable(GL_CULL_FACE);
+        gl_state().disable(GL_BLEND);
+        gl_state().bind_vertex_array(vao_);
         
-        glMultiDrawArrays(GL_TRIANGLE_FAN, elements_start_indexes_, element_vertex_count_, polygons_count_); //
-        glBindVertexArray(0);  // Unbind vao
+        glMultiDrawArrays(GL_TRIANGLE_FAN, elements_start_indexes_.data(), element_vertex_count_.data(), polygons_count_); //
+        gl_state().count_draw();
 
         // Draw outline lines
-        outline_lines_ptr->draw(view_matrix, projection_matrix);
+        outline_lines_ptr->draw();
+    }
+
+    // Queue the draw, sorted with the other opaque layers by program and distance to the camera
+    void submit(RenderQueue& queue)
+    {
+        if (!queue.visible(bounds_))
+            return;
+        queue.submit(RenderPass::OPAQUE, "polygons", m_polygon_shader->ID, 0, center_, [this]() { draw(); });
+    }
+
+    // Model space box and sphere, tested against the view frustum before submitting
+    const Bounds& bounds() const
+    {
+        return bounds_;
+    }
+
+    // Fill and outline together
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.cpu_bytes = heap_bytes(vertices_) + heap_bytes(elements_start_indexes_) + heap_bytes(element_vertex_count_);
+        usage.gpu_bytes = vertex_count_*sizeof(SimpleVertex);
+        usage += outline_lines_ptr->memory_usage();
+        return usage;
     }
 
 private:
     Color fill_color_ = Color::GREEN;
     Color linecolor_ = Color::BLUE;
     float linewidth_ = DEFAULT_LINE_WIDTH;
-    std::vector<std::vector<Eigen::Vector3f>> polygons_;
     GLuint polygons_count_ = 1;
-    GLsizei elements_start_indexes_[MAX_FEATURES];
-    GLsizei element_vertex_count_[MAX_FEATURES];
-    std::vector<SimpleVertex> vertices_;
+    std::vector<GLint> elements_start_indexes_;
+    std::vector<GLsizei> element_vertex_count_;
+    std::vector<SimpleVertex> vertices_;  // empty after setup() unless Retention::KEEP_ALL
+    std::size_t vertex_count_ = 0;
+    Bounds bounds_;
+    glm::vec3 center_ = glm::vec3(0.0f);  // sort position in the render queue
     unsigned int vao_, vbo_;
     
-    Shader* m_polygon_shader;
-    Line* outline_lines_ptr;
+    std::shared_ptr<Shader> m_polygon_shader;
+    std::unique_ptr<Line> outline_lines_ptr;
 };
\ No newline at end of file
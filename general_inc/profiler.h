@@ -0,0 +1,197 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const std::size_t PROFILER_BUFFER_EVENTS = 1 << 16;  // events kept per thread (oldest are overwritten)
+const char PROFILER_TRACE_ENVIRONMENT_VARIABLE[] = "OPENGL_PLAYGROUND_TRACE";  // trace file written at exit
+
+/// One closed scope
+struct ProfileEvent {
+    const char* name;  // string literal
+    std::uint64_t start_ns;  // since the profiler epoch
+    std::uint64_t duration_ns;
+};
+
+/// Ring buffer of the events of one thread, only that thread writes to it
+struct ProfileBuffer {
+    std::vector<ProfileEvent> events = std::vector<ProfileEvent>(PROFILER_BUFFER_EVENTS);
+    std::atomic<std::uint64_t> written{0};  // total events recorded, the ring holds the last PROFILER_BUFFER_EVENTS
+    std::uint32_t thread_index = 0;
+    const char* thread_name = nullptr;  // string literal shown in the trace viewer
+
+    void record(const char* name, std::uint64_t start_ns, std::uint64_t duration_ns)
+    {
+        std::uint64_t index = written.load(std::memory_order_relaxed);
+        events[index % PROFILER_BUFFER_EVENTS] = {name, start_ns, duration_ns};
+        written.store(index + 1, std::memory_order_release);
+    }
+};
+
+/// Scoped CPU profiler exporting Chrome trace_event JSON (open it in Perfetto or chrome://tracing).
+// Recording is enabled when OPENGL_PLAYGROUND_TRACE names the file to write at exit, or with
+// set_enabled(). Every thread records into its own ring buffer so the hot path takes no lock,
+// the lock is only taken the first time a thread records and when dumping. A dump taken while
+// other threads record may contain a few torn events at the wrap point of their ring.
+class Profiler
+{
+public:
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    bool enabled() const
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void set_enabled(bool enabled)
+    {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    std::uint64_t now_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    // Buffer of the calling thread, created on first use
+    ProfileBuffer& thread_buffer()
+    {
+        thread_local ProfileBuffer* buffer = register_thread();
+        return *buffer;
+    }
+
+    // Names the calling thread in the trace
+    void set_thread_name(const char* name)
+    {
+        thread_buffer().thread_name = name;
+    }
+
+    // Writes all recorded events as Chrome trace_event JSON, returns false if the file can't be written
+    bool dump(const std::string& path)
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cout << "ERROR::PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        std::size_t event_count = 0;
+        for (auto const& buffer: buffers_) {
+            if (!first) { file << ","; }
+            first = false;
+            file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_index
+                 << ",\"args\":{\"name\":\"";
+            if (buffer->thread_name != nullptr) { write_escaped(file, buffer->thread_name); }
+            else { file << "thread " << buffer->thread_index; }
+            file << "\"}}";
+
+            std::uint64_t written = buffer->written.load(std::memory_order_acquire);
+            std::uint64_t begin = written > PROFILER_BUFFER_EVENTS ? written - PROFILER_BUFFER_EVENTS : 0;
+            for (std::uint64_t i = begin; i < written; i++) {
+                ProfileEvent const& event = buffer->events[i % PROFILER_BUFFER_EVENTS];
+                file << ",{\"name\":\"";
+                write_escaped(file, event.name);
+                file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_index
+                     << ",\"ts\":" << event.start_ns/1000.0 << ",\"dur\":" << event.duration_ns/1000.0 << "}";
+                event_count++;
+            }
+        }
+        file << "]}" << std::endl;
+        std::cout << "Profiler: " << event_count << " events written to " << path << std::endl;
+        return true;
+    }
+
+private:
+    Profiler()
+    {
+        const char* path = std::getenv(PROFILER_TRACE_ENVIRONMENT_VARIABLE);
+        if (path != nullptr && path[0] != '\0')
+        {
+            exit_trace_path_ = path;
+            enabled_ = true;
+        }
+    }
+
+    ~Profiler()
+    {
+        if (!exit_trace_path_.empty()) { dump(exit_trace_path_); }
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    ProfileBuffer* register_thread()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // owned by the profiler so the events outlive the thread (eg. the Qt render thread)
+        buffers_.push_back(std::make_shared<ProfileBuffer>());
+        buffers_.back()->thread_index = static_cast<std::uint32_t>(buffers_.size() - 1);
+        return buffers_.back().get();
+    }
+
+    static void write_escaped(std::ofstream& file, const char* text)
+    {
+        for (; *text != '\0'; ++text) {
+            if (*text == '"' || *text == '\\') { file << '\\'; }
+            file << *text;
+        }
+    }
+
+    std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+    std::atomic<bool> enabled_{false};
+    std::string exit_trace_path_;
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<ProfileBuffer>> buffers_;
+};
+
+/// Records the lifetime of the scope it is declared in
+class ScopedProfile
+{
+public:
+    explicit ScopedProfile(const char* name)
+    {
+        Profiler& profiler = Profiler::instance();
+        if (!profiler.enabled()) { return; }
+        name_ = name;
+        start_ns_ = profiler.now_ns();
+    }
+
+    ~ScopedProfile()
+    {
+        if (name_ == nullptr) { return; }
+        Profiler& profiler = Profiler::instance();
+        std::uint64_t end_ns = profiler.now_ns();
+        profiler.thread_buffer().record(name_, start_ns_, end_ns - start_ns_);
+    }
+
+    ScopedProfile(const ScopedProfile&) = delete;
+    ScopedProfile& operator=(const ScopedProfile&) = delete;
+
+private:
+    const char* name_ = nullptr;
+    std::uint64_t start_ns_ = 0;
+};
+
+#define PROFILE_CONCATENATE_INNER(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_INNER(a, b)
+// Times the enclosing scope under name (must be a string literal or otherwise outlive the dump)
+#define PROFILE_SCOPE(name) ScopedProfile PROFILE_CONCATENATE(profile_scope_, __LINE__)(name)
+
+#endif
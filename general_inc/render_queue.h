@@ -0,0 +1,209 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glm/glm.hpp>
+
+#include <QOpenGLContext>
+
+#include <general_inc/bounds.h>
+#include <general_inc/gpu_timer.h>
+#include <general_inc/profiler.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// Passes in the order they are drawn
+// Opaque geometry first (front to back so the depth test rejects hidden fragments early),
+// then the skybox which only fills the pixels left at the far plane (GL_LEQUAL) and finally
+// the blended geometry back to front.
+enum class RenderPass: std::uint8_t { OPAQUE = 0, SKYBOX = 1, TRANSPARENT = 2 };
+
+const unsigned int RENDER_QUEUE_DEPTH_BITS = 24;
+const unsigned int RENDER_QUEUE_ID_BITS = 12;  // program and texture names are folded onto 12 bits for sorting
+
+/// What a draw submitted with per draw data gets when it runs, pointing into the queue's buffers
+struct DrawParameters {
+    const glm::mat4* matrices = nullptr;  // eg. the model matrix
+    std::size_t matrix_count = 0;
+    const unsigned char* bytes = nullptr;  // eg. the levels of detail of a model's meshes
+    std::size_t byte_count = 0;
+};
+
+/// One draw submitted by a layer
+struct DrawItem {
+    std::uint64_t key;
+    std::uint32_t sequence;  // submission order, breaks the ties of key
+    const char* label;  // layer name used by the GPU timers (string literal)
+    GLuint program;
+    GLuint texture;
+    std::uint32_t first_matrix, matrix_count;  // in the queue's matrices of the frame
+    std::uint32_t first_byte, byte_count;      // in the queue's bytes of the frame
+    std::function<void(const DrawParameters&)> draw;
+};
+
+/// Program and texture switches the queue would have made in submission order and made after sorting,
+// and the bounds tested against the view frustum (see RenderQueue::visible)
+struct RenderQueueStatistics {
+    std::size_t items = 0;
+    std::size_t visible = 0;
+    std::size_t culled = 0;
+    std::size_t program_switches_submitted = 0;
+    std::size_t program_switches_sorted = 0;
+    std::size_t texture_switches_submitted = 0;
+    std::size_t texture_switches_sorted = 0;
+};
+
+/// Collects the draws of a frame and executes them sorted by a 64 bit key.
+// Key layout (most significant bits first):
+//   opaque/skybox: pass (2) | program (12) | texture (12) | depth (24)
+//   transparent:   pass (2) | inverted depth (24) | program (12) | texture (12)
+// so opaque items are grouped by program and texture and drawn front to back inside a
+// group, while transparent items keep strict back to front ordering.
+class RenderQueue
+{
+public:
+    // Starts a new frame, depth is the view space distance to world_position normalised by far_plane
+    void begin(const glm::mat4& view_matrix, const glm::mat4& projection_matrix, float far_plane)
+    {
+        view_ = view_matrix;
+        far_plane_ = far_plane;
+        frustum_ = Frustum(projection_matrix * view_matrix);
+        visible_ = 0;
+        culled_ = 0;
+        items_.clear();  // keeps the capacity from the previous frame
+        matrices_.clear();
+        bytes_.clear();
+    }
+
+    // Whether bounds placed by model_matrix are (at least partly) inside the view frustum of the frame.
+    // Layers ask before submitting and skip their draws when it is false.
+    bool visible(const Bounds& bounds, const glm::mat4& model_matrix = glm::mat4(1.0f))
+    {
+        if (frustum_.intersects(bounds, model_matrix))
+        {
+            visible_++;
+            return true;
+        }
+        culled_++;
+        return false;
+    }
+
+    // A draw that needs nothing but its object, eg. [this]() { draw(); }
+    template <typename Draw>
+    void submit(RenderPass pass, const char* label, GLuint program, GLuint texture, const glm::vec3& world_position,
+                Draw draw)
+    {
+        submit(pass, label, program, texture, world_position, nullptr, 0, nullptr, 0,
+               [draw = std::move(draw)](const DrawParameters&) { draw(); });
+    }
+
+    // A draw with per draw data: the matrices and bytes are copied to buffers of the queue (cleared, not
+    // shrunk, every frame) and handed to draw when it runs. A closure capturing no more than two pointers
+    // fits in std::function without allocating, and an object can be submitted several times per frame.
+    void submit(RenderPass pass, const char* label, GLuint program, GLuint texture, const glm::vec3& world_position,
+                const glm::mat4* matrices, std::size_t matrix_count, const unsigned char* bytes, std::size_t byte_count,
+                std::function<void(const DrawParameters&)> draw)
+    {
+        const std::uint32_t sequence = static_cast<std::uint32_t>(items_.size());
+        const std::uint32_t first_matrix = static_cast<std::uint32_t>(matrices_.size());
+        const std::uint32_t first_byte = static_cast<std::uint32_t>(bytes_.size());
+        matrices_.insert(matrices_.end(), matrices, matrices + matrix_count);
+        bytes_.insert(bytes_.end(), bytes, bytes + byte_count);
+        items_.push_back({make_key(pass, program, texture, depth_bits(world_position)), sequence, label, program, texture,
+                          first_matrix, static_cast<std::uint32_t>(matrix_count), first_byte, static_cast<std::uint32_t>(byte_count),
+                          std::move(draw)});
+    }
+
+    void submit(RenderPass pass, const char* label, GLuint program, GLuint texture, const glm::vec3& world_position,
+                const glm::mat4& model_matrix, std::function<void(const DrawParameters&)> draw)
+    {
+        submit(pass, label, program, texture, world_position, &model_matrix, 1, nullptr, 0, std::move(draw));
+    }
+
+    // Sorts and executes all submitted items, each one timed under its label when timers are given
+    void flush(GpuTimers* timers = nullptr)
+    {
+        PROFILE_SCOPE("RenderQueue::flush");
+        statistics_.items = items_.size();
+        statistics_.visible = visible_;
+        statistics_.culled = culled_;
+        count_switches(statistics_.program_switches_submitted, statistics_.texture_switches_submitted);
+
+        // equal keys keep their submission order, without the buffer std::stable_sort allocates
+        std::sort(items_.begin(), items_.end(), [](const DrawItem& a, const DrawItem& b) {
+            return a.key < b.key || (a.key == b.key && a.sequence < b.sequence);
+        });
+        count_switches(statistics_.program_switches_sorted, statistics_.texture_switches_sorted);
+
+        for (DrawItem& item: items_) {
+            ScopedProfile item_scope(item.label);
+            DrawParameters parameters;
+            parameters.matrices = matrices_.data() + item.first_matrix;
+            parameters.matrix_count = item.matrix_count;
+            parameters.bytes = bytes_.data() + item.first_byte;
+            parameters.byte_count = item.byte_count;
+            if (timers != nullptr) { timers->begin(item.label); }
+            item.draw(parameters);
+            if (timers != nullptr) { timers->end(); }
+        }
+    }
+
+    const RenderQueueStatistics& statistics() const
+    {
+        return statistics_;
+    }
+
+private:
+    std::uint32_t depth_bits(const glm::vec3& world_position) const
+    {
+        const std::uint32_t max_depth = (1u << RENDER_QUEUE_DEPTH_BITS) - 1;
+        float distance = -(view_ * glm::vec4(world_position, 1.0f)).z;  // camera looks down -z
+        float normalised = glm::clamp(distance / far_plane_, 0.0f, 1.0f);
+        return static_cast<std::uint32_t>(normalised * max_depth);
+    }
+
+    static std::uint64_t make_key(RenderPass pass, GLuint program, GLuint texture, std::uint32_t depth)
+    {
+        const std::uint64_t id_mask = (1u << RENDER_QUEUE_ID_BITS) - 1;
+        const std::uint64_t depth_mask = (1u << RENDER_QUEUE_DEPTH_BITS) - 1;
+        std::uint64_t key = static_cast<std::uint64_t>(pass) << 62;
+        if (pass == RenderPass::TRANSPARENT)
+        {
+            key |= ((depth_mask - depth) & depth_mask) << (2*RENDER_QUEUE_ID_BITS);  // far first
+            key |= (program & id_mask) << RENDER_QUEUE_ID_BITS;
+            key |= (texture & id_mask);
+        }
+        else
+        {
+            key |= (program & id_mask) << (RENDER_QUEUE_ID_BITS + RENDER_QUEUE_DEPTH_BITS);
+            key |= (texture & id_mask) << RENDER_QUEUE_DEPTH_BITS;
+            key |= (depth & depth_mask);  // near first
+        }
+        return key;
+    }
+
+    void count_switches(std::size_t& program_switches, std::size_t& texture_switches) const
+    {
+        program_switches = 0;
+        texture_switches = 0;
+        for (std::size_t i = 0; i < items_.size(); i++) {
+            if (i == 0 || items_[i].program != items_[i - 1].program) { program_switches++; }
+            if (items_[i].texture != 0 && (i == 0 || items_[i].texture != items_[i - 1].texture)) { texture_switches++; }
+        }
+    }
+
+    std::vector<DrawItem> items_;
+    std::vector<glm::mat4> matrices_;       // per draw data of the frame, see DrawParameters
+    std::vector<unsigned char> bytes_;
+    glm::mat4 view_ = glm::mat4(1.0f);
+    float far_plane_ = 1.0f;
+    Frustum frustum_;
+    std::size_t visible_ = 0;
+    std::size_t culled_ = 0;
+    RenderQueueStatistics statistics_;
+};
+
+#endif
@@ -3,22 +3,60 @@
 
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLExtraFunctions>
 #include <glm/glm.hpp>
 
+#include <general_inc/paths.h>
+#include <general_inc/gl_state.h>
+#include <general_inc/utilities.h>
+
+#include <cstdint>
+#include <cstdio>
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <iomanip>
+#include <iterator>
+
+// FNV-1a hash of a uniform name, computed in place so lookups don't need a std::string
+constexpr std::uint32_t uniform_name_hash(const char* name)
+{
+    std::uint32_t hash = 2166136261u;
+    for (; *name != '\0'; ++name)
+    {
+        hash ^= static_cast<unsigned char>(*name);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Uniform buffer binding point of the per-frame "CameraBlock" shared by all programs
+const GLuint CAMERA_BLOCK_BINDING = 0;
+
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile (same values for both)
+const GLenum GL_COMPLETION_STATUS = 0x91B1;
+const GLuint MAX_SHADER_COMPILER_THREADS_DEFAULT = 0xFFFFFFFF;  // let the driver pick the thread count
+
+/// Uniform location resolved once by Shader::uniform()
+struct Uniform {
+    GLint location = -1;
+};
 
 class Shader: protected QOpenGLFunctions_3_3_Core
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor submits the shaders for compilation and linking without waiting for the
+    // driver, the program is finalized (status checked, uniforms cached) on first use or
+    // by ShaderRegistry::finalize_all() so that all programs of a scene compile together
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
         initializeOpenGLFunctions();   // Initialise current context
+        enableParallelCompile();
 
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -60,113 +98,497 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        // 2. a program binary cached by a previous run skips compilation entirely
+        bool use_binary_cache = binaryCacheAvailable();
+        std::uint64_t binary_key = 0;
+        if (use_binary_cache)
+        {
+            binary_key = programBinaryKey(vertexCode, geometryCode, fragmentCode);
+            if (loadProgramBinary(binary_key))
+            {
+                from_binary_cache_ = true;
+                finalize();
+                return;
+            }
+        }
+        use_binary_cache_ = use_binary_cache;
+        binary_key_ = binary_key;
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. submit the shaders, nothing is queried here so the driver can compile in the background
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        pending_shaders_.push_back({vertex, "VERTEX"});
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        pending_shaders_.push_back({fragment, "FRAGMENT"});
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
         if(geometryPath != nullptr)
         {
             const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            unsigned int geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            pending_shaders_.push_back({geometry, "GEOMETRY"});
         }
-        // shader Program
+        // shader Program (linking is queued behind the compiles)
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
+        for (auto const& pending: pending_shaders_)
+            glAttachShader(ID, pending.shader);
+        if (use_binary_cache)
+            QOpenGLContext::currentContext()->extraFunctions()->glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
+    }
+    // programs are shared through the ShaderRegistry, copying would double delete them
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    ~Shader()
+    {
+        for (auto const& pending: pending_shaders_)
+            glDeleteShader(pending.shader);
+        GLState::instance().forget_program(ID);
+        glDeleteProgram(ID);
+    }
+    // compilation and linking state
+    // ------------------------------------------------------------------------
+    // true once finalize() would not block (always true without parallel compile support)
+    bool ready()
+    {
+        if (finalized_ || !parallel_compile_)
+            return true;
+        GLint completed = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS, &completed);
+        return completed == GL_TRUE;
+    }
+    // waits for the driver, reports errors and fills the uniform tables
+    void finalize()
+    {
+        if (finalized_)
+            return;
+        finalized_ = true;
+        for (auto const& pending: pending_shaders_)
+        {
+            checkCompileErrors(pending.shader, pending.type);
+        }
         checkCompileErrors(ID, "PROGRAM");
+        cacheUniformLocations();
+        bindUniformBlocks();
+        if (use_binary_cache_)
+            saveProgramBinary(binary_key_);
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        for (auto const& pending: pending_shaders_)
+            glDeleteShader(pending.shader);
+        pending_shaders_.clear();
+    }
+    bool finalized() const
+    {
+        return finalized_;
+    }
+    bool from_binary_cache() const
+    {
+        return from_binary_cache_;
+    }
+    static bool parallel_compile()
+    {
+        return parallel_compile_;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        finalize();
+        GLState::instance().use_program(ID); 
+    }
+    // uniform locations
+    // ------------------------------------------------------------------------
+    // Looks up a location in the table filled at link time. Names are hashed in place and
+    // compared with the stored name, so this neither allocates nor queries GL (unless the
+    // name isn't an active uniform) and a name colliding with another can't get its location.
+    GLint location(const char* name)
+    {
+        finalize();
+        std::uint32_t hash = uniform_name_hash(name);
+        auto range = uniform_locations_.equal_range(hash);
+        for (auto entry = range.first; entry != range.second; ++entry)
+        {
+            if (entry->second.name == name)
+            {
+                uniform_lookups_saved_++;
+                return entry->second.location;
+            }
+        }
+        // not an active uniform (eg optimised out): remember it so we only ask GL once
+        GLint uniform_loc = glGetUniformLocation(ID, name);
+        uniform_locations_.emplace(hash, UniformEntry{name, uniform_loc});
+        return uniform_loc;
+    }
+    // typed handle that can be resolved once and reused every frame
+    Uniform uniform(const char* name)
+    {
+        return Uniform{location(name)};
+    }
+    // Directory used to cache linked program binaries between runs (empty disables the cache)
+    static void set_binary_cache_directory(const std::string& directory)
+    {
+        binary_cache_directory_ = directory;
+    }
+    static unsigned long binary_cache_hits()
+    {
+        return binary_cache_hits_;
+    }
+    static unsigned long binary_cache_misses()
+    {
+        return binary_cache_misses_;
+    }
+    // Number of glGetUniformLocation calls avoided since the last reset (all programs)
+    static unsigned long lookups_saved()
+    {
+        return uniform_lookups_saved_;
+    }
+    static void reset_lookup_statistics()
+    {
+        uniform_lookups_saved_ = 0;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
+    void setBool(Uniform uniform, bool value)
+    {         
+        glUniform1i(uniform.location, (int)value); 
+    }
+    void setBool(const char* name, bool value)
+    {         
+        setBool(Uniform{location(name)}, value); 
+    }
     void setBool(const std::string &name, bool value)
     {         
-        GLint uniform_loc = glGetUniformLocation(ID, name.c_str());
-        glUniform1i(uniform_loc, (int)value); 
+        setBool(name.c_str(), value); 
     }
     // ------------------------------------------------------------------------
+    void setInt(Uniform uniform, int value)
+    { 
+        glUniform1i(uniform.location, value); 
+    }
+    void setInt(const char* name, int value)
+    { 
+        setInt(Uniform{location(name)}, value); 
+    }
     void setInt(const std::string &name, int value)
     { 
-        GLint uniform_loc = glGetUniformLocation(ID, name.c_str());
-        glUniform1i(uniform_loc, value); 
+        setInt(name.c_str(), value); 
     }
     // ------------------------------------------------------------------------
+    void setFloat(Uniform uniform, float value)
+    { 
+        glUniform1f(uniform.location, value); 
+    }
+    void setFloat(const char* name, float value)
+    { 
+        setFloat(Uniform{location(name)}, value); 
+    }
     void setFloat(const std::string &name, float value)
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        setFloat(name.c_str(), value); 
     }
     // ------------------------------------------------------------------------
+    void setVec2(Uniform uniform, const glm::vec2 &value)
+    { 
+        glUniform2fv(uniform.location, 1, &value[0]); 
+    }
+    void setVec2(const char* name, const glm::vec2 &value)
+    { 
+        setVec2(Uniform{location(name)}, value); 
+    }
     void setVec2(const std::string &name, const glm::vec2 &value)
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec2(name.c_str(), value); 
+    }
+    void setVec2(const char* name, float x, float y)
+    { 
+        glUniform2f(location(name), x, y); 
     }
     void setVec2(const std::string &name, float x, float y)
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        setVec2(name.c_str(), x, y); 
     }
     // ------------------------------------------------------------------------
+    void setVec3(Uniform uniform, const glm::vec3 &value)
+    { 
+        glUniform3fv(uniform.location, 1, &value[0]); 
+    }
+    void setVec3(const char* name, const glm::vec3 &value)
+    { 
+        setVec3(Uniform{location(name)}, value); 
+    }
     void setVec3(const std::string &name, const glm::vec3 &value)
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec3(name.c_str(), value); 
+    }
+    void setVec3(const char* name, float x, float y, float z)
+    { 
+        glUniform3f(location(name), x, y, z); 
     }
     void setVec3(const std::string &name, float x, float y, float z)
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        setVec3(name.c_str(), x, y, z); 
     }
     // ------------------------------------------------------------------------
+    void setVec4(Uniform uniform, const glm::vec4 &value)
+    { 
+        glUniform4fv(uniform.location, 1, &value[0]); 
+    }
+    void setVec4(const char* name, const glm::vec4 &value)
+    { 
+        setVec4(Uniform{location(name)}, value); 
+    }
     void setVec4(const std::string &name, const glm::vec4 &value)
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        setVec4(name.c_str(), value); 
+    }
+    void setVec4(const char* name, float x, float y, float z, float w) 
+    { 
+        glUniform4f(location(name), x, y, z, w); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        setVec4(name.c_str(), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
+    void setMat2(Uniform uniform, const glm::mat2 &mat)
+    {
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat2(const char* name, const glm::mat2 &mat)
+    {
+        setMat2(Uniform{location(name)}, mat);
+    }
     void setMat2(const std::string &name, const glm::mat2 &mat)
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(name.c_str(), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat3(Uniform uniform, const glm::mat3 &mat)
+    {
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(const char* name, const glm::mat3 &mat)
+    {
+        setMat3(Uniform{location(name)}, mat);
+    }
     void setMat3(const std::string &name, const glm::mat3 &mat)
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(name.c_str(), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat4(Uniform uniform, const glm::mat4 &mat)
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(const char* name, const glm::mat4 &mat)
+    {
+        setMat4(Uniform{location(name)}, mat);
+    }
     void setMat4(const std::string &name, const glm::mat4 &mat)
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(name.c_str(), mat);
     }
 
 private:
+    struct PendingShader {
+        GLuint shader;
+        const char* type;  // stage name used in the error messages
+    };
+    std::vector<PendingShader> pending_shaders_;  // compiled shaders waiting for finalize()
+    bool finalized_ = false;
+    bool from_binary_cache_ = false;
+    bool use_binary_cache_ = false;
+    std::uint64_t binary_key_ = 0;
+
+    static inline bool parallel_compile_checked_ = false;
+    static inline bool parallel_compile_ = false;
+
+    struct UniformEntry {
+        std::string name;
+        GLint location;
+    };
+    std::unordered_multimap<std::uint32_t, UniformEntry> uniform_locations_;  // uniform name hash -> name and location
+    static inline unsigned long uniform_lookups_saved_ = 0;
+
+    static inline std::string binary_cache_directory_;
+    static inline unsigned long binary_cache_hits_ = 0;
+    static inline unsigned long binary_cache_misses_ = 0;
+
+    // parallel compilation (GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile)
+    // ------------------------------------------------------------------------
+    static void enableParallelCompile()
+    {
+        if (parallel_compile_checked_)
+            return;
+        parallel_compile_checked_ = true;
+
+        QOpenGLContext* context = QOpenGLContext::currentContext();
+        if (context == nullptr)
+            return;
+        typedef void (QOPENGLF_APIENTRY *MaxShaderCompilerThreads)(GLuint count);
+        MaxShaderCompilerThreads set_thread_count = nullptr;
+        if (context->hasExtension(QByteArray("GL_KHR_parallel_shader_compile")))
+            set_thread_count = reinterpret_cast<MaxShaderCompilerThreads>(context->getProcAddress("glMaxShaderCompilerThreadsKHR"));
+        else if (context->hasExtension(QByteArray("GL_ARB_parallel_shader_compile")))
+            set_thread_count = reinterpret_cast<MaxShaderCompilerThreads>(context->getProcAddress("glMaxShaderCompilerThreadsARB"));
+        if (set_thread_count == nullptr)
+            return;
+
+        set_thread_count(MAX_SHADER_COMPILER_THREADS_DEFAULT);
+        parallel_compile_ = true;
+    }
+
+    // program binary cache (GL_ARB_get_program_binary)
+    // ------------------------------------------------------------------------
+    bool binaryCacheAvailable()
+    {
+        QOpenGLContext* context = QOpenGLContext::currentContext();
+        if (binary_cache_directory_.empty() || context == nullptr || 
+            !context->hasExtension(QByteArray("GL_ARB_get_program_binary")))
+            return false;
+
+        GLint format_count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+        return format_count > 0;
+    }
+
+    // binaries are only valid for the exact sources on the exact driver that produced them
+    std::uint64_t programBinaryKey(const std::string& vertexCode, const std::string& geometryCode, const std::string& fragmentCode)
+    {
+        std::uint64_t key = hash_bytes(vertexCode.data(), vertexCode.size());
+        key = hash_bytes(geometryCode.data(), geometryCode.size(), key);
+        key = hash_bytes(fragmentCode.data(), fragmentCode.size(), key);
+        for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            if (value != nullptr)
+                key = hash_bytes(value, std::char_traits<char>::length(value), key);
+        }
+        return key;
+    }
+
+    std::string programBinaryPath(std::uint64_t key)
+    {
+        std::stringstream file_name;
+        file_name << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+        return (fs::path(binary_cache_directory_) / file_name.str()).string();
+    }
+
+    bool loadProgramBinary(std::uint64_t key)
+    {
+        std::string path = programBinaryPath(key);
+        std::ifstream file(path, std::ios::binary);
+        GLenum format = 0;
+        if (!file.read(reinterpret_cast<char*>(&format), sizeof(format)))
+        {
+            binary_cache_misses_++;
+            return false;
+        }
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+
+        ID = glCreateProgram();
+        QOpenGLContext::currentContext()->extraFunctions()->glProgramBinary(ID, format, binary.data(), (GLsizei)binary.size());
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // the driver rejected the binary (eg driver update), drop it and compile from source
+            while (glGetError() != GL_NO_ERROR) {}
+            glDeleteProgram(ID);
+            std::remove(path.c_str());
+            binary_cache_misses_++;
+            return false;
+        }
+        binary_cache_hits_++;
+        return true;
+    }
+
+    void saveProgramBinary(std::uint64_t key)
+    {
+        GLint success = 0;
+        GLint length = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        QOpenGLContext::currentContext()->extraFunctions()->glGetProgramBinary(ID, length, nullptr, &format, binary.data());
+
+        try {
+            fs::create_directories(fs::path(binary_cache_directory_));
+        }
+        catch (fs::filesystem_error& e) {
+            std::cout << "ERROR::SHADER::CACHE_DIRECTORY_NOT_CREATED " << e.what() << std::endl;
+            return;
+        }
+        std::ofstream file(programBinaryPath(key), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(binary.data(), binary.size());
+        if (!file)
+            std::cout << "ERROR::SHADER::PROGRAM_BINARY_NOT_SAVED" << std::endl;
+    }
+
+    // fill the location table by enumerating the active uniforms of the linked program
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        GLint uniform_count = 0;
+        GLint max_name_length = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniform_count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+        std::vector<GLchar> name(max_name_length + 1);
+        for (GLint i = 0; i < uniform_count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            GLint uniform_loc = glGetUniformLocation(ID, name.data());
+            if (uniform_loc < 0)
+                continue;  // member of a uniform block
+
+            std::string uniform_name(name.data(), length);
+            registerUniform(uniform_name, uniform_loc);
+            // arrays are reported as "name[0]", make them reachable as "name" too
+            std::size_t bracket = uniform_name.find('[');
+            if (bracket != std::string::npos)
+                registerUniform(uniform_name.substr(0, bracket), uniform_loc);
+        }
+    }
+
+    // attach the shared uniform blocks to their binding points
+    void bindUniformBlocks()
+    {
+        GLuint block_index = glGetUniformBlockIndex(ID, "CameraBlock");
+        if (block_index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, block_index, CAMERA_BLOCK_BINDING);
+    }
+
+    void registerUniform(const std::string& name, GLint uniform_loc)
+    {
+        const std::uint32_t hash = uniform_name_hash(name.c_str());
+        auto range = uniform_locations_.equal_range(hash);
+        for (auto entry = range.first; entry != range.second; ++entry)
+        {
+            if (entry->second.name == name)
+                return;
+        }
+        uniform_locations_.emplace(hash, UniformEntry{name, uniform_loc});
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
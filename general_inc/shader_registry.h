@@ -0,0 +1,123 @@
+#ifndef SHADER_REGISTRY_H
+#define SHADER_REGISTRY_H
+
+#include <general_inc/shader.h>
+#include <general_inc/paths.h>
+
+#include <map>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+/// Process-wide cache of linked shader programs.
+// Layers ask the registry for a program by its (vs, gs, fs) paths and get back a
+// reference-counted handle. The first request compiles and links the program, every
+// following request for the same paths shares it. Once the last handle is released
+// the program is deleted and the entry expires.
+// Programs are only submitted to the driver when acquired, call finalize_all() once the
+// scene is built to wait for all of them together (they compile in parallel when the
+// driver supports GL_KHR/ARB_parallel_shader_compile).
+class ShaderRegistry
+{
+public:
+    static ShaderRegistry& instance()
+    {
+        static ShaderRegistry registry;
+        return registry;
+    }
+
+    std::shared_ptr<Shader> acquire(const std::string& vertex_path, const std::string& fragment_path,
+                                    const std::string& geometry_path = std::string())
+    {
+        std::string key = vertex_path + '|' + geometry_path + '|' + fragment_path;
+
+        auto entry = programs_.find(key);
+        if (entry != programs_.end())
+        {
+            if (std::shared_ptr<Shader> shader = entry->second.lock())
+            {
+                hits_++;
+                return shader;
+            }
+        }
+
+        std::shared_ptr<Shader> shader = std::make_shared<Shader>(vertex_path.c_str(), fragment_path.c_str(),
+                                                                  geometry_path.empty() ? nullptr : geometry_path.c_str());
+        programs_[key] = shader;
+        misses_++;
+        return shader;
+    }
+
+    // Finalizes every pending program, in the order the driver finishes them, and reports compile times
+    void finalize_all()
+    {
+        std::vector<std::pair<const std::string*, std::shared_ptr<Shader>>> pending;
+        for (auto const& entry: programs_) {
+            std::shared_ptr<Shader> shader = entry.second.lock();
+            if (shader && !shader->finalized()) { pending.emplace_back(&entry.first, shader); }
+        }
+        if (pending.empty())
+            return;
+
+        // The programs were submitted while the scene was being built, only the wait for the
+        // driver from here on is attributable to compiling (and writing the binary cache)
+        const std::size_t program_count = pending.size();
+        const auto start = std::chrono::steady_clock::now();
+        while (!pending.empty())
+        {
+            bool progress = false;
+            for (auto it = pending.begin(); it != pending.end();)
+            {
+                if (it->second->ready())
+                {
+                    it->second->finalize();
+                    it = pending.erase(it);
+                    progress = true;
+                }
+                else { ++it; }
+            }
+            if (!progress) { std::this_thread::yield(); }  // the driver threads are still busy
+        }
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Shader registry: finalized " << program_count << " programs in " << milliseconds << " ms"
+                  << (Shader::parallel_compile() ? " (parallel compile)" : "") << std::endl;
+    }
+
+    // Number of programs currently alive
+    std::size_t size() const
+    {
+        std::size_t alive = 0;
+        for (auto const& entry: programs_) {
+            if (!entry.second.expired()) { alive++; }
+        }
+        return alive;
+    }
+
+    void print_statistics() const
+    {
+        std::cout << "Shader registry: " << misses_ << " programs compiled, "
+                  << hits_ << " shared, " << size() << " alive (binary cache: "
+                  << Shader::binary_cache_hits() << " hits, " << Shader::binary_cache_misses() << " misses)" << std::endl;
+    }
+
+private:
+    ShaderRegistry() = default;
+    ShaderRegistry(const ShaderRegistry&) = delete;
+    ShaderRegistry& operator=(const ShaderRegistry&) = delete;
+
+    std::map<std::string, std::weak_ptr<Shader>> programs_;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+};
+
+// Shorthand used by the layer classes
+std::shared_ptr<Shader> get_shader(const fs::path& vertex_path, const fs::path& fragment_path,
+                                   const fs::path& geometry_path = fs::path())
+{
+    return ShaderRegistry::instance().acquire(vertex_path.string(), fragment_path.string(), geometry_path.string());
+}
+
+#endif
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <sstream>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -9,29 +13,100 @@
 #include <QOpenGLContext> 
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <general_inc/shader.h>
+#include <general_inc/shader_registry.h>
+#include <general_inc/camera_block.h>
+#include <general_inc/render_queue.h>
+#include <general_inc/font_cache.h>
+#include <general_inc/profiler.h>
 
-#include <ft2build.h>
-#include FT_FREETYPE_H  
 
-/// Holds all state information relevant to a character as loaded using FreeType
-struct Character {
-    unsigned int TextureID; // ID handle of the glyph texture
-    glm::ivec2   Size;      // Size of glyph
-    glm::ivec2   Bearing;   // Offset from baseline to left/top of glyph
-    unsigned int Advance;   // Horizontal offset to advance to next glyph
+/// Vertex of a glyph quad: position in the text's plane and texture coordinates in the atlas
+struct GlyphVertex {
+    glm::vec3 Position;
+    glm::vec2 TexCoords;
 };
 
 const char NEWLINE_CHARACTER = '\n';
 const float MULTILINE_TEXT_HEIGHT_OFFSET_FACTOR = 1.2;
 
+// Code points of every line of a UTF-8 text, bottom line first
+std::vector<std::u32string> split_lines(const std::string& text)
+{
+    std::vector<std::u32string> lines;
+    auto string_stream = std::stringstream{text};
+    for (std::string line; std::getline(string_stream, line, NEWLINE_CHARACTER);) {
+        lines.push_back(utf8_to_utf32(line));
+    }
+    std::reverse(lines.begin(), lines.end());
+    return lines;
+}
+
+// World (or screen) units per atlas pixel for a text scale given per pixel of a GLYPH_PIXEL_SIZE
+// glyph, the same text size whatever size the font was baked at
+float glyph_scale(const Font& font, float scale)
+{
+    return scale*GLYPH_PIXEL_SIZE/font.pixel_size;
+}
+
+// Places the glyphs of lines (bottom line first, see split_lines) from the origin, each line
+// resting on its lowest descender. emit(character, x, y, width, height) receives the quad of every
+// glyph, scale being the glyph_scale(). The atlas pages of the glyphs are set in pages.
+template <typename EmitGlyph>
+void layout_glyphs(Font& font, const std::vector<std::u32string>& lines, float scale, std::uint32_t* pages, EmitGlyph emit)
+{
+    const float pad = font.spread;  // distance field margin, left out of the line metrics
+
+    float start_x = 0.0;
+    float start_y = 0.0;
+
+    for (std::u32string const& line_entry: lines) {
+        float max_caracter_height_in_line = 0;
+
+        float highest_origin = 0;
+        for (char32_t c: line_entry)
+        {
+            const Character& ch = font.character(c);
+            float origin = (ch.Size.y - ch.Bearing.y - pad) * scale;
+            if (origin > highest_origin) { highest_origin = origin; }
+        }
+
+        for (char32_t c: line_entry)
+        {
+            const Character& ch = font.character(c, pages);
+
+            float xpos = start_x + ch.Bearing.x * scale;
+            float ypos = start_y - (ch.Size.y - ch.Bearing.y) * scale + highest_origin;
+
+            float character_height = std::max(ch.Size.y - 2*pad, 0.0f) * scale;
+            if (character_height > max_caracter_height_in_line)
+            {
+                max_caracter_height_in_line = character_height;
+            }
+
+            if (ch.Size.x > 0 && ch.Size.y > 0) { emit(ch, xpos, ypos, ch.Size.x * scale, ch.Size.y * scale); }
+
+            // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
+            start_x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
+        }
+
+        // At the end of line push text up
+        start_x = 0.0; // Reset to start of line
+        float next_line_height_offset = MULTILINE_TEXT_HEIGHT_OFFSET_FACTOR*max_caracter_height_in_line;
+        start_y += next_line_height_offset;
+    }
+}
+
 class Text3D: protected QOpenGLFunctions_3_3_Core
 {
 public:
     
+    // scale is per pixel of a GLYPH_PIXEL_SIZE glyph whatever the rendering. Distance field glyphs
+    // (the default) stay sharp at every size and can have an outline and a halo.
     Text3D(std::string text_to_write, float x, float y, float z, float scale, 
-            glm::vec3 color = {0, 0, 0}, float offset_x_screen = 0, float offset_y_screen = 0)
+            glm::vec3 color = {0, 0, 0}, float offset_x_screen = 0, float offset_y_screen = 0,
+            GlyphRendering rendering = GlyphRendering::SDF)
     {
+        m_rendering = rendering;
         process_text(text_to_write); 
         m_scale = scale;
         m_x = x;
@@ -45,10 +120,8 @@ public:
 
         initializeOpenGLFunctions();   // Initialise current context  (required)
 
-        // Text shaders
-        const char* vertex_text = TEXT_VS.string().c_str();
-        const char* fragment_text = TEXT_FS.string().c_str();
-        m_text_shader = new Shader(vertex_text, fragment_text);
+        // Text shaders (shared between all text instances)
+        m_text_shader = get_shader(TEXT_VS, TEXT_FS);
 
         // Front 
         std::string font_path = TEXT_FONT_PATH.string();
@@ -56,18 +129,18 @@ public:
         setup(font_path);
     }
 
-    ~Text3D() {
-        delete m_text_shader;
-    }
-
+    // The quads are only rebuilt when the text differs from the current one
     void change_text(std::string text_to_write, float x, float y, float z)
     {
-        process_text(text_to_write); 
+        if (text_to_write != m_text) {
+            process_text(text_to_write);
+        }
         m_x = x;
         m_y = y;
         m_z = z;
     }
     
+    // The glyphs come from the process-wide FontCache, only the quads belong to the text
     void setup(std::string font_path)
     {
         // find path to font
@@ -75,106 +148,35 @@ public:
         {
             std::cout << "ERROR::FREETYPE: Failed to load font_name" << std::endl;
         }
+        m_font = &FontCache::instance().acquire(font_path, m_rendering);
 
-        // FreeType
-        // --------
-        FT_Library ft;
-        // All functions return a value different than 0 whenever an error occurred
-        if (FT_Init_FreeType(&ft))
-        {
-            std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
-        }
-
-        // load font as face
-        FT_Face face;
-        if (FT_New_Face(ft, font_path.c_str(), 0, &face)) {
-            std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
-        }
-        else {
-            // set size to load glyphs as
-            FT_Set_Pixel_Sizes(face, 0, 48);
-
-            // disable byte-alignment restriction
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-            // load first 128 characters of ASCII set
-            for (unsigned char c = 0; c < 128; c++)
-            {
-                // Load character glyph 
-                if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-                {
-                    std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
-                    continue;
-                }
-                // generate texture
-                unsigned int texture;
-                glGenTextures(1, &texture);
-                glBindTexture(GL_TEXTURE_2D, texture);  // Bind texture
-                glTexImage2D(
-                    GL_TEXTURE_2D,
-                    0,
-                    GL_RED,
-                    face->glyph->bitmap.width,
-                    face->glyph->bitmap.rows,
-                    0,
-                    GL_RED,
-                    GL_UNSIGNED_BYTE,
-                    face->glyph->bitmap.buffer
-                );
-                // set texture options
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                // now store character for later use
-                Character character = {
-                    texture,
-                    glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-                    glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-                    static_cast<unsigned int>(face->glyph->advance.x)
-                };
-                m_characters.insert(std::pair<char, Character>(c, character));
-            }
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
-        // destroy FreeType once we're finished
-        FT_Done_Face(face);
-        FT_Done_FreeType(ft);
-
-        // configure VAO/VBO for (text) texture quads
+        // configure VAO/VBO for (text) texture quads, filled by build_quads()
         // -----------------------------------
         glGenVertexArrays(1, &vao_);
         glGenBuffers(1, &vbo_);
-        glBindVertexArray(vao_);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 5, NULL, GL_DYNAMIC_DRAW);
+        gl_state().bind_vertex_array(vao_);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
 
         // Positions:
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GlyphVertex), (void*)offsetof(GlyphVertex, Position));
 
         // Texture coordinates:
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-        
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphVertex), (void*)offsetof(GlyphVertex, TexCoords));
     }
 
+    // text is UTF-8, glyphs outside ASCII are rasterised the first time they are drawn
     void process_text(std::string text_to_process)
     {
-        // Pre-process text we want to write from bottom to top
-        std::vector<std::string> lines_of_text;
-        auto string_stream = std::stringstream{text_to_process};
+        m_text = text_to_process;
+        quads_dirty_ = true;
 
-        for (std::string line; std::getline(string_stream, line, NEWLINE_CHARACTER);) {
-            lines_of_text.push_back(line);
-        }
-        std::reverse(lines_of_text.begin(), lines_of_text.end());
-        lines_of_text_ = lines_of_text;
+        // Pre-process text we want to write from bottom to top
+        lines_of_text_ = split_lines(text_to_process);
 
     }
+    // The quads are relative to the position (text_position uniform), moving the text doesn't rebuild them
     void update_position(float x, float y, float z) 
     {
         m_x = x;
@@ -182,7 +184,24 @@ public:
         m_z = z;
     }
 
+    // Outline around the glyphs, width in atlas pixels (see SDF_SPREAD, 0 removes it). SDF only.
+    void set_outline(glm::vec4 color, float width)
+    {
+        m_outline_color = color;
+        m_outline_width = glm::clamp(width, 0.0f, m_font->spread);
+        m_halo_width = std::min(m_halo_width, m_font->spread - m_outline_width);
+    }
+
+    // Soft glow fading out from the glyphs (or their outline), width in atlas pixels. SDF only.
+    void set_halo(glm::vec4 color, float width)
+    {
+        m_halo_color = color;
+        m_halo_width = glm::clamp(width, 0.0f, m_font->spread - m_outline_width);
+    }
+
     std::pair<float, float> get_text_screen_size() {
+        const float scale = glyph_scale(*m_font, m_scale);
+        const float pad = m_font->spread;  // distance field margin around the glyphs
 
         float start_x = 0.0;
         float start_y = 0.0;
@@ -190,26 +209,26 @@ public:
         float total_height_of_text = 0;
         float max_line_width = 0;
 
-        for (std::string const& line_entry: lines_of_text_) {
-            std::string::const_iterator c;
+        for (std::u32string const& line_entry: lines_of_text_) {
+            std::u32string::const_iterator c;
 
             float max_caracter_height_in_line = 0;
 
             for (c = line_entry.begin(); c != line_entry.end(); c++) 
             {
-                Character ch = m_characters[*c];
-                float xpos = start_x + ch.Bearing.x * m_scale + m_offset_x_screen;
-                float character_height = ch.Size.y * m_scale ;
+                const Character& ch = m_font->character(*c);
+                float xpos = start_x + (ch.Bearing.x + pad) * scale + m_offset_x_screen;
+                float character_height = std::max(ch.Size.y - 2*pad, 0.0f) * scale;
                 if (character_height > max_caracter_height_in_line)
                 {
                     max_caracter_height_in_line = character_height;
                 }
-                float end_of_character_x_pos = xpos + ch.Size.x * m_scale;
+                float end_of_character_x_pos = xpos + std::max(ch.Size.x - 2*pad, 0.0f) * scale;
                 if (end_of_character_x_pos > max_line_width)
                 {
                     max_line_width = end_of_character_x_pos;
                 }
-                start_x += (ch.Advance >> 6) * m_scale; // bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
+                start_x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
             
             }
 
@@ -222,116 +241,119 @@ public:
         return std::make_pair(max_line_width, total_height_of_text);
     }
 
+    // Upload the given matrices to the shared camera block (skipped if they are already current) and draw
     void draw(glm::mat4 view_matrix, 
               glm::mat4 projection_matrix,
               bool fixed_size = true)
+    {
+        CameraBlock::instance().update_if_changed(view_matrix, projection_matrix);
+        draw(fixed_size);
+    }
+
+    // Draw using the camera matrices (and camera right/up vectors) of the shared CameraBlock uniform buffer
+    void draw(bool fixed_size = true)
     {
         // OpenGL state
         // ------------
-        glEnable(GL_CULL_FACE);
-        glEnable(GL_BLEND);  // enabling blending 
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // setting blending function
+        gl_state().enable(GL_CULL_FACE);
+        gl_state().enable(GL_BLEND);  // enabling blending 
+        gl_state().blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // setting blending function
 
         // activate corresponding render state	
         m_text_shader->use();
 
-		// http://www.opengl-tutorial.org/intermediate-tutorials/billboards-particles/billboards/
-		m_text_shader->setVec3("camera_right_worldspace", view_matrix[0][0], view_matrix[1][0], view_matrix[2][0]);
-		m_text_shader->setVec3("camera_up_worldspace", view_matrix[0][1], view_matrix[1][1], view_matrix[2][1]);
         m_text_shader->setVec3("text_position", m_x, m_y, m_z);
         m_text_shader->setBool("fixed_size", fixed_size);
 
-        m_text_shader->setMat4("projection", projection_matrix);
-        m_text_shader->setMat4("view", view_matrix);
         m_text_shader->setVec3("textColor", m_color); // Set uniform
-        glActiveTexture(GL_TEXTURE0);  // set texture slot to 0th 
-        glBindVertexArray(vao_);
-
-        // Iterate through characters
-
-        // iterate through all characters
-        float start_x = 0.0;
-        float start_y = 0.0;
-        float start_z = 0.0;
-        
-        for (std::string const& line_entry: lines_of_text_) {
-            std::string::const_iterator c;
 
-            float max_caracter_height_in_line = 0;
-
-            float highest_origin = 0;
-            for (c = line_entry.begin(); c != line_entry.end(); c++) 
-            {
-                Character ch = m_characters[*c];
-                float origin = (ch.Size.y - ch.Bearing.y) * m_scale;
-                if (origin > highest_origin) { highest_origin = origin; }
-            }
-
-            for (c = line_entry.begin(); c != line_entry.end(); c++) 
-            {
-                Character ch = m_characters[*c];
-
-                float xpos = start_x + ch.Bearing.x * m_scale + m_offset_x_screen;
-                float ypos = start_y - (ch.Size.y - ch.Bearing.y) * m_scale + m_offset_y_screen + highest_origin;
-
-                float character_height = ch.Size.y * m_scale;
-                if (character_height > max_caracter_height_in_line)
-                {
-                    max_caracter_height_in_line = character_height;
-                }
-
-                float w = ch.Size.x * m_scale;
-                float h = ch.Size.y * m_scale;
-                // update VBO for each character
-                float vertices[6][5] = {
-                    { xpos,     ypos + h,  start_z,    0.0f, 0.0f },            
-                    { xpos,     ypos,      start_z,    0.0f, 1.0f },
-                    { xpos + w, ypos,      start_z,    1.0f, 1.0f },
-
-                    { xpos,     ypos + h,  start_z,    0.0f, 0.0f },
-                    { xpos + w, ypos,      start_z,    1.0f, 1.0f },
-                    { xpos + w, ypos + h,  start_z,    1.0f, 0.0f }           
-                };
-
-                // render glyph texture over quad
-                glBindTexture(GL_TEXTURE_2D, ch.TextureID);  // bind the correct texture object to active texture slot (0th)
-                // update content of VBO memory
-                glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-                glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);  // sets data within a specified region
-                // of the currently bound buffer object. 
-                // be sure to use glBufferSubData and not glBufferData
-
-                glBindBuffer(GL_ARRAY_BUFFER, 0);
-                // render quad
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-                start_x += (ch.Advance >> 6) * m_scale; // bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
-            
-            }
-
-            // At the end of line push text up
-            start_x = 0.0; // Reset to start of line
-            float next_line_height_offset = MULTILINE_TEXT_HEIGHT_OFFSET_FACTOR*max_caracter_height_in_line;
-            start_y += next_line_height_offset;
+        // Widths in distance units, the atlas goes from 0 to 1 over 2*spread pixels
+        const bool sdf = m_font->rendering == GlyphRendering::SDF;
+        m_text_shader->setBool("sdf", sdf);
+        if (sdf)
+        {
+            m_text_shader->setFloat("outline_width", m_outline_width/(2.0f*m_font->spread));
+            m_text_shader->setVec4("outlineColor", m_outline_color);
+            m_text_shader->setFloat("halo_width", m_halo_width/(2.0f*m_font->spread));
+            m_text_shader->setVec4("haloColor", m_halo_color);
         }
-        
-        glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
 
-        // Reset defaults
-        glDisable(GL_CULL_FACE);
-        glDisable(GL_BLEND);
+        // Rebuilt as well when the font emptied an atlas page, some of the glyphs may have been there
+        if (quads_dirty_ || m_font->evictions() != built_evictions_) { build_quads(); }
+        m_font->touch(glyph_pages_);
+
+        // The whole text in one draw, every glyph is in the atlas
+        gl_state().bind_texture(0, GL_TEXTURE_2D, m_font->atlas_texture);
+        gl_state().bind_vertex_array(vao_);
+        glDrawArrays(GL_TRIANGLES, 0, quad_vertex_count_);
+        gl_state().count_draw();
+    }
 
+    // Glyphs are blended so text goes with the transparent items (drawn back to front)
+    void submit(RenderQueue& queue, bool fixed_size = true)
+    {
+        queue.submit(RenderPass::TRANSPARENT, "text", m_text_shader->ID, m_font->atlas_texture, glm::vec3(m_x, m_y, m_z),
+                     [this, fixed_size]() { draw(fixed_size); });
     }
 
 private:
+    // Lays out the quads of every glyph (lines from bottom to top, each line resting on its lowest
+    // descender) and uploads them, growing the buffer only when the text gets longer
+    void build_quads()
+    {
+        PROFILE_SCOPE("Text3D::build_quads");
+        std::vector<GlyphVertex> vertices;
+        vertices.reserve(6*m_text.size());
+
+        const float start_z = 0.0;
+        const std::size_t overflows = m_font->overflows();
+        glyph_pages_ = 0;
+        layout_glyphs(*m_font, lines_of_text_, glyph_scale(*m_font, m_scale), &glyph_pages_,
+                      [&](const Character& ch, float x, float y, float w, float h) {
+            float xpos = x + m_offset_x_screen;
+            float ypos = y + m_offset_y_screen;
+            // two triangles per glyph, the atlas rows go from the top of the glyph down
+            vertices.push_back({{xpos,     ypos + h, start_z}, {ch.UVMin.x, ch.UVMin.y}});
+            vertices.push_back({{xpos,     ypos,     start_z}, {ch.UVMin.x, ch.UVMax.y}});
+            vertices.push_back({{xpos + w, ypos,     start_z}, {ch.UVMax.x, ch.UVMax.y}});
+
+            vertices.push_back({{xpos,     ypos + h, start_z}, {ch.UVMin.x, ch.UVMin.y}});
+            vertices.push_back({{xpos + w, ypos,     start_z}, {ch.UVMax.x, ch.UVMax.y}});
+            vertices.push_back({{xpos + w, ypos + h, start_z}, {ch.UVMax.x, ch.UVMin.y}});
+        });
+
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo_);
+        if (vertices.size() > quad_vertex_capacity_)
+        {
+            quad_vertex_capacity_ = vertices.size();
+            glBufferData(GL_ARRAY_BUFFER, quad_vertex_capacity_*sizeof(GlyphVertex), vertices.data(), GL_DYNAMIC_DRAW);
+        }
+        else if (!vertices.empty())
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size()*sizeof(GlyphVertex), vertices.data());
+        }
+        quad_vertex_count_ = static_cast<GLsizei>(vertices.size());
+        // a glyph that didn't fit in the atlas is blank, try again next frame when pages are free
+        quads_dirty_ = m_font->overflows() != overflows;
+        built_evictions_ = m_font->evictions();
+    }
 
-    std::map<GLchar, Character> m_characters;
-    Shader* m_text_shader;
+    Font* m_font = nullptr;               // shared glyph atlas, owned by the FontCache
+    std::uint32_t glyph_pages_ = 0;       // atlas pages of the glyphs in the quads
+    std::size_t built_evictions_ = 0;     // m_font->evictions() when the quads were built
+    GlyphRendering m_rendering = GlyphRendering::SDF;
+    glm::vec4 m_outline_color = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    float m_outline_width = 0.0f;         // [atlas px]
+    glm::vec4 m_halo_color = glm::vec4(1.0f, 1.0f, 1.0f, 0.5f);
+    float m_halo_width = 0.0f;            // [atlas px]
+    std::shared_ptr<Shader> m_text_shader;
     unsigned int vao_, vbo_;
+    GLsizei quad_vertex_count_ = 0;       // 6 per glyph of the text
+    std::size_t quad_vertex_capacity_ = 0;
+    bool quads_dirty_ = true;             // text changed or glyphs were missing when the quads were built
 
     std::string m_text;
-    std::vector<std::string> lines_of_text_;
+    std::vector<std::u32string> lines_of_text_;
     float m_scale;
     float m_x;
     float m_y;
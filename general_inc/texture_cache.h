@@ -0,0 +1,177 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <stb_image.h>
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <general_inc/gl_state.h>
+#include <general_inc/paths.h>
+#include <general_inc/profiler.h>
+#include <general_inc/thread_pool.h>
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// Pixels decoded by stb_image on a worker thread
+struct DecodedImage {
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels{nullptr, stbi_image_free};
+};
+
+// Decodes an image file, flipping it bottom row first when asked. stb_image's own flip flag
+// is global state shared by every decoding thread, so it is never set and rows are swapped here.
+DecodedImage decode_image(const std::string& path, bool flip_vertically)
+{
+    PROFILE_SCOPE("decode_image");
+    DecodedImage image;
+    image.pixels.reset(stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0));
+    if (image.pixels && flip_vertically)
+    {
+        const std::size_t row_bytes = std::size_t(image.width)*image.components;
+        std::vector<unsigned char> row(row_bytes);
+        unsigned char* pixels = image.pixels.get();
+        for (int top = 0, bottom = image.height - 1; top < bottom; top++, bottom--) {
+            std::memcpy(row.data(), pixels + top*row_bytes, row_bytes);
+            std::memcpy(pixels + top*row_bytes, pixels + bottom*row_bytes, row_bytes);
+            std::memcpy(pixels + bottom*row_bytes, row.data(), row_bytes);
+        }
+    }
+    return image;
+}
+
+/// Process-wide cache of 2D textures loaded from image files, keyed by canonical path.
+// acquire() returns the GL name straight away and queues the decoding on the worker pool,
+// so all the textures of a scene decode in parallel while models keep loading. Only the
+// upload (glTexImage2D and the mipmaps) runs on the render thread, in upload_ready() or
+// finalize_all(). Until then a texture is incomplete and samples black.
+// Textures live as long as the GL context.
+class TextureCache: protected QOpenGLFunctions_3_3_Core
+{
+public:
+    static TextureCache& instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    GLuint acquire(const std::string& path, bool flip_vertically = true)
+    {
+        std::string key = canonical_path(path);
+        auto entry = textures_.find(key);
+        if (entry != textures_.end())
+        {
+            hits_++;
+            return entry->second;
+        }
+
+        PendingTexture pending;
+        pending.path = key;
+        pending.decoded = worker_pool().submit([key, flip_vertically]() { return decode_image(key, flip_vertically); });
+        glGenTextures(1, &pending.id);
+        GLuint id = pending.id;
+        textures_[key] = id;
+        pending_.push_back(std::move(pending));
+        misses_++;
+        return id;
+    }
+
+    // Uploads the textures whose decoding is done, never waits
+    void upload_ready()
+    {
+        for (auto it = pending_.begin(); it != pending_.end();)
+        {
+            if (it->decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                upload(*it);
+                it = pending_.erase(it);
+            }
+            else { ++it; }
+        }
+    }
+
+    // Waits for every pending texture and uploads it, in the order the decoding finishes
+    void finalize_all()
+    {
+        if (pending_.empty())
+            return;
+        PROFILE_SCOPE("TextureCache::finalize_all");
+        auto start = std::chrono::steady_clock::now();
+        std::size_t count = pending_.size();
+        while (!pending_.empty())
+        {
+            upload_ready();
+            if (!pending_.empty()) { pending_.front().decoded.wait(); }
+        }
+        std::cout << "Texture cache: " << count << " textures decoded on " << worker_pool().size() << " threads and uploaded in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms" << std::endl;
+    }
+
+    void print_statistics() const
+    {
+        std::cout << "Texture cache: " << misses_ << " textures loaded, " << hits_ << " shared" << std::endl;
+    }
+
+private:
+    struct PendingTexture {
+        std::string path;
+        GLuint id = 0;
+        std::future<DecodedImage> decoded;
+    };
+
+    TextureCache()
+    {
+        initializeOpenGLFunctions();   // Initialise current context  (required)
+    }
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    void upload(PendingTexture& pending)
+    {
+        PROFILE_SCOPE("TextureCache::upload");
+        DecodedImage image = pending.decoded.get();
+        if (!image.pixels)
+        {
+            std::cout << "Texture failed to load at path: " << pending.path << std::endl;
+            return;
+        }
+
+        GLenum format = GL_RGBA;
+        if (image.components == 1)
+            format = GL_RED;
+        else if (image.components == 2)
+            format = GL_RG;
+        else if (image.components == 3)
+            format = GL_RGB;
+
+        gl_state().bind_texture(0, GL_TEXTURE_2D, pending.id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // rows of RGB images aren't 4 byte aligned
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    std::unordered_map<std::string, GLuint> textures_;  // canonical path -> texture
+    std::vector<PendingTexture> pending_;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+};
+
+#endif
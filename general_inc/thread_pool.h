@@ -0,0 +1,90 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Fixed set of worker threads running queued tasks in submission order.
+// Tasks must not touch OpenGL (workers have no context), hand their results back through
+// the returned future. The destructor runs the tasks still queued before joining.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int thread_count)
+    {
+        for (unsigned int i = 0; i < std::max(thread_count, 1u); i++) {
+            workers_.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker: workers_) { worker.join(); }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<decltype(task())>
+    {
+        // packaged_task is move only, std::function needs a copyable callable
+        auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<Task>(task));
+        std::future<decltype(task())> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([packaged]() { (*packaged)(); });
+        }
+        wake_.notify_one();
+        return result;
+    }
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(workers_.size());
+    }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) { return; }  // stopping and drained
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
+
+// Process-wide pool for CPU work off the render thread (one thread per core left to the render thread)
+ThreadPool& worker_pool()
+{
+    static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    return pool;
+}
+
+#endif
@@ -3,12 +3,18 @@
 
 #include <glm/glm.hpp>
 
+#include <general_inc/bounds.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
 constexpr float DEFAULT_LINE_WIDTH = 5;
 constexpr float LINEWIDTH_SCALING_FACTOR = 0.0005; 
 constexpr float MIN_LINE_WIDTH = 1;
 constexpr float MAX_LINE_WIDTH = 20;
 constexpr double M_PI = 3.141592653589793238462643;
-constexpr int MAX_FEATURES = 100000000; // Max number of features (lines/polygons) that can be draw in one call
 
 /// Looks like colours to me
 enum class Color { RED, GREEN, BLUE, BLACK, WHITE, TRANSPARENT_BLUE, TRANSPARENT_WHITE};
@@ -46,4 +52,64 @@ std::vector<double> make_step_vector(double beginning, double step, double end)
     return output_vector;
 };
 
+/// What a layer keeps in CPU memory once its geometry is uploaded
+enum class Retention {
+    DROP_AFTER_UPLOAD,  // only what drawing needs (draw ranges, counts)
+    KEEP_FOR_PICKING,   // and what test_ray_tracing reads
+    KEEP_ALL            // and the source coordinates and uploaded vertices
+};
+
+/// Bytes a layer keeps resident in CPU memory (heap) and in GL buffers
+struct MemoryUsage {
+    std::size_t cpu_bytes = 0;
+    std::size_t gpu_bytes = 0;
+
+    MemoryUsage& operator+=(const MemoryUsage& other)
+    {
+        cpu_bytes += other.cpu_bytes;
+        gpu_bytes += other.gpu_bytes;
+        return *this;
+    }
+};
+
+// Heap bytes held by a vector (capacity, not size)
+template <typename T>
+std::size_t heap_bytes(const std::vector<T>& values)
+{
+    return values.capacity()*sizeof(T);
+}
+
+template <typename T>
+std::size_t heap_bytes(const std::vector<std::vector<T>>& values)
+{
+    std::size_t bytes = values.capacity()*sizeof(std::vector<T>);
+    for (auto const& inner: values) { bytes += heap_bytes(inner); }
+    return bytes;
+}
+
+// Frees the memory of a vector (clear() keeps the capacity)
+template <typename T>
+void release(std::vector<T>& values)
+{
+    std::vector<T>().swap(values);
+}
+
+/// 64 bit FNV-1a hash of a block of memory (chain calls by passing the previous hash as seed)
+std::uint64_t hash_bytes(const void* data, std::size_t size, std::uint64_t seed = 14695981039346656037ull)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    std::uint64_t hash = seed;
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+/// Box and sphere around the vertices (culling and the position used to sort a layer's draws)
+template <typename VertexType>
+Bounds vertex_bounds(const std::vector<VertexType>& vertices)
+{
+    return bounds_of(vertices, [](const VertexType& vertex) { return vertex.Position; });
+}
+
 #endif
\ No newline at end of file
@@ -2,11 +2,19 @@
 
 layout (location = 0) in vec3 aPos;
 
+layout (std140) uniform CameraBlock
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_right;
+    vec4 camera_up;
+    vec4 viewport;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = view_projection * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#version 330 core
+in vec2 TexCoords;
+in vec4 GlyphColor;
+out vec4 color;
+
+uniform sampler2D text;
+
+// As text.fs, with the color of each label
+uniform bool sdf;
+uniform float outline_width;
+uniform vec4 outlineColor;
+uniform float halo_width;
+uniform vec4 haloColor;
+
+void main()
+{
+    float value = texture(text, TexCoords).r;
+    if (!sdf)
+    {
+        color = vec4(GlyphColor.rgb, GlyphColor.a * value);
+        return;
+    }
+
+    // Antialias over one screen pixel whatever the text size
+    float aa = max(fwidth(value), 1e-4);
+    float fill = smoothstep(0.5 - aa, 0.5 + aa, value);
+    float edge = 0.5 - outline_width;
+    float body = smoothstep(edge - aa, edge + aa, value);
+
+    vec4 glyph = vec4(GlyphColor.rgb, 1.0);
+    if (outline_width > 0.0)
+    {
+        glyph = mix(outlineColor, glyph, fill);
+    }
+    glyph.a *= body;
+
+    // The halo fades out from the edge of the outline, under the text
+    float halo = halo_width > 0.0 ? haloColor.a * smoothstep(edge - halo_width, edge, value) : 0.0;
+    float alpha = glyph.a + halo * (1.0 - glyph.a);
+    vec3 rgb = alpha > 0.0 ? (glyph.rgb * glyph.a + haloColor.rgb * halo * (1.0 - glyph.a)) / alpha : glyph.rgb;
+    color = vec4(rgb, alpha * GlyphColor.a);
+}
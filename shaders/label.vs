@@ -0,0 +1,42 @@
+#version 330 core
+// One instance per glyph, the quad's corners come from gl_VertexID (triangle strip of 4)
+layout (location = 0) in vec3 anchor;   // position of the label
+layout (location = 1) in vec4 quad;     // left, bottom, width, height of the glyph from the anchor
+layout (location = 2) in vec4 uv_rect;  // top left and bottom right of the glyph in the atlas
+layout (location = 3) in vec4 color;
+out vec2 TexCoords;
+out vec4 GlyphColor;
+
+layout (std140) uniform CameraBlock
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_right;
+    vec4 camera_up;
+    vec4 viewport;
+};
+
+uniform bool fixed_size = true;
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 offset = quad.xy + corner * quad.zw;
+
+    // Billboards as in text.vs: along the camera's right/up vectors, or in screen space
+    if (fixed_size) {
+        gl_Position = view_projection * vec4(anchor, 1.0f);
+        gl_Position /= gl_Position.w;
+        gl_Position.xy += offset;
+    }
+    else {
+        vec3 vertex_position_worldspace = anchor + camera_right.xyz * offset.x + camera_up.xyz * offset.y;
+        gl_Position = view_projection * vec4(vertex_position_worldspace, 1.0f);
+    }
+    gl_Position.z -= 0.000002; // Makes sure text is slightly offset from origin point
+
+    // the atlas rows go from the top of the glyph down
+    TexCoords = vec2(mix(uv_rect.x, uv_rect.z, corner.x), mix(uv_rect.w, uv_rect.y, corner.y));
+    GlyphColor = color;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstanceModel;  // one per instance, see MeshArena::set_instance_buffer
+
+out vec2 TexCoords;
+
+layout (std140) uniform CameraBlock
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_right;
+    vec4 camera_up;
+    vec4 viewport;
+};
+
+void main()
+{
+    TexCoords = aTexCoords;    
+    gl_Position = view_projection * aInstanceModel * vec4(aPos, 1.0);
+}
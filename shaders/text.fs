@@ -5,11 +5,40 @@ out vec4 color;
 uniform sampler2D text;
 uniform vec3 textColor;
 
+// Distance field glyphs: 0.5 on the outline, more inside. Widths are in the same units.
+uniform bool sdf;
+uniform float outline_width;
+uniform vec4 outlineColor;
+uniform float halo_width;
+uniform vec4 haloColor;
+
 void main()
 {    
-    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);  // Because the texture's data is stored
-    // in just its red component, we sample the r component of the texture as the sampled alpha value.
-    //  By varying the output color's alpha value, the resulting pixel will be transparent for all the
-    // glyph's background colors and non-transparent for the actual character pixels. 
-    color = vec4(textColor, 1.0) * sampled;
-}
\ No newline at end of file
+    float value = texture(text, TexCoords).r;
+    if (!sdf)
+    {
+        // The bitmap's coverage is stored in its red component, used as the alpha so the
+        // glyph's background is transparent.
+        color = vec4(textColor, value);
+        return;
+    }
+
+    // Antialias over one screen pixel whatever the text size
+    float aa = max(fwidth(value), 1e-4);
+    float fill = smoothstep(0.5 - aa, 0.5 + aa, value);
+    float edge = 0.5 - outline_width;
+    float body = smoothstep(edge - aa, edge + aa, value);
+
+    vec4 glyph = vec4(textColor, 1.0);
+    if (outline_width > 0.0)
+    {
+        glyph = mix(outlineColor, glyph, fill);
+    }
+    glyph.a *= body;
+
+    // The halo fades out from the edge of the outline, under the text
+    float halo = halo_width > 0.0 ? haloColor.a * smoothstep(edge - halo_width, edge, value) : 0.0;
+    float alpha = glyph.a + halo * (1.0 - glyph.a);
+    vec3 rgb = alpha > 0.0 ? (glyph.rgb * glyph.a + haloColor.rgb * halo * (1.0 - glyph.a)) / alpha : glyph.rgb;
+    color = vec4(rgb, alpha);
+}
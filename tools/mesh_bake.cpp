@@ -0,0 +1,90 @@
+/// Pre-bakes the mesh cache of every model under a directory.
+// Runs the same Assimp import as Model::loadModel and writes the cache files Model reads at
+// startup, so the application never has to run Assimp. Files whose cache is up to date are
+// skipped. No OpenGL context is needed.
+//   ./build/mesh_bake [--cache <directory>] [--force] [<models directory>]
+
+#include <general_inc/mesh_cache.h>
+#include <general_inc/model_import.h>
+#include <general_inc/paths.h>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// Extensions of the model files baked (lower case)
+const std::set<std::string> MODEL_EXTENSIONS = {".obj", ".fbx", ".dae", ".gltf", ".glb", ".3ds", ".ply", ".stl", ".blend"};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Pre-bake the mesh cache of every model under a directory");
+    parser.addHelpOption();
+    QCommandLineOption cache_option("cache", "Mesh cache directory.", "directory", QString::fromStdString(MESH_CACHE_PATH.string()));
+    QCommandLineOption force_option("force", "Rebake models whose cache is up to date.");
+    parser.addOption(cache_option);
+    parser.addOption(force_option);
+    parser.addPositionalArgument("models", "Directory searched recursively for models (default resources/objects).");
+    parser.process(app);
+
+    const std::string cache_directory = parser.value(cache_option).toStdString();
+    const QStringList positional = parser.positionalArguments();
+    const fs::path models_directory = positional.isEmpty() ? ASSETS_PATH : fs::path(positional.first().toStdString());
+
+    std::vector<std::string> sources;
+    try {
+        for (auto const& entry: fs::recursive_directory_iterator(models_directory)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (fs::is_regular_file(entry.status()) && MODEL_EXTENSIONS.count(extension) > 0) {
+                sources.push_back(entry.path().string());
+            }
+        }
+    }
+    catch (fs::filesystem_error& e) {
+        std::cerr << "ERROR::MESH_BAKE::DIRECTORY_NOT_READ " << e.what() << std::endl;
+        return 1;
+    }
+    std::sort(sources.begin(), sources.end());
+
+    int baked = 0, up_to_date = 0, failed = 0;
+    for (auto const& source: sources) {
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t key = mesh_cache_key(source);
+        if (key == 0) {
+            std::cout << "  " << source << ": not readable" << std::endl;
+            failed++;
+            continue;
+        }
+        std::string cache_path = mesh_cache_path(cache_directory, source);
+
+        MeshCacheFile existing;
+        if (!parser.isSet(force_option) && existing.open(cache_path, key)) {
+            std::cout << "  " << source << ": up to date" << std::endl;
+            up_to_date++;
+            continue;
+        }
+
+        std::vector<ImportedMesh> meshes;
+        if (!import_model(source, meshes) || !write_mesh_cache(cache_path, key, meshes)) {
+            std::cout << "  " << source << ": failed" << std::endl;
+            failed++;
+            continue;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "  " << source << " -> " << cache_path << " (" << meshes.size() << " meshes, " << ms << " ms)" << std::endl;
+        baked++;
+    }
+
+    std::cout << baked << " baked, " << up_to_date << " up to date, " << failed << " failed" << std::endl;
+    return failed > 0 ? 1 : 0;
+}